@@ -0,0 +1,341 @@
+#include "buddhabrot.h"
+
+#include <algorithm>
+#include <random>
+
+namespace {
+
+struct Complex
+{
+    double x;
+    double y;
+};
+
+Complex
+multiplyComplex(Complex a, Complex b)
+{
+    return { a.x * b.x - a.y * b.y, a.x * b.y + a.y * b.x };
+}
+
+// Same test as in `fragment_shader.frag`: the main cardioid and the period-2
+// bulb never escape.
+bool
+isInsideMainComponents(Complex c)
+{
+    double y2 = c.y * c.y;
+
+    double q = (c.x - 0.25) * (c.x - 0.25) + y2;
+    if (q * (q + (c.x - 0.25)) <= 0.25 * y2) {
+        return true;
+    }
+
+    return (c.x + 1.0) * (c.x + 1.0) + y2 <= 0.0625;
+}
+
+// Number of iterations before the orbit of `c` leaves the bailout radius of
+// the shader, or 0 when it stays within `jumps` iterations.
+int
+escapeIterations(Complex c, int jumps)
+{
+    if (isInsideMainComponents(c)) {
+        return 0;
+    }
+
+    Complex z = { 0.0, 0.0 };
+    for (int i = 1; i <= jumps; i++) {
+        z = multiplyComplex(z, z);
+        z = { z.x + c.x, z.y + c.y };
+        if (z.x * z.x + z.y * z.y >= 100.0) {
+            return i;
+        }
+    }
+
+    return 0;
+}
+
+// Bit `i` is set when channel `i` counts an orbit escaping after `iterations`.
+uint32_t
+channelMask(const std::array<int, 3>& limits, int iterations)
+{
+    uint32_t mask = 0;
+    for (int channel = 0; channel < 3; channel++) {
+        if (iterations > 0 && iterations <= limits[channel]) {
+            mask |= 1u << channel;
+        }
+    }
+    return mask;
+}
+
+struct Visit
+{
+    uint32_t pixel;
+    uint32_t channels;
+    float weight;
+};
+
+// Appends the orbit of `c` and of its conjugate to `visits`, skipping points
+// outside the view, and returns the number of points inside.
+int
+traceOrbit(const BuddhabrotView& view,
+           Complex c,
+           int iterations,
+           uint32_t channels,
+           float weight,
+           std::vector<Visit>* visits)
+{
+    double scaleX = view.pixelsX / view.width;
+    double scaleY = view.pixelsY / view.height;
+
+    int inside = 0;
+    Complex z = { 0.0, 0.0 };
+    for (int i = 0; i < iterations; i++) {
+        z = multiplyComplex(z, z);
+        z = { z.x + c.x, z.y + c.y };
+
+        double x = (z.x - view.left) * scaleX;
+        if (x < 0.0 || x >= view.pixelsX) {
+            continue;
+        }
+
+        for (double y : { (z.y - view.bottom) * scaleY,
+                          (-z.y - view.bottom) * scaleY }) {
+            if (y < 0.0 || y >= view.pixelsY) {
+                continue;
+            }
+            inside++;
+            if (visits) {
+                uint32_t pixel = (uint32_t)y * view.pixelsX + (uint32_t)x;
+                visits->push_back({ pixel, channels, weight });
+            }
+        }
+    }
+    return inside;
+}
+
+const double gridExtent = 2.0;
+
+Complex
+cellPoint(int cell, double u, double v)
+{
+    double size = 2.0 * gridExtent / Buddhabrot::gridSize;
+    int column = cell % Buddhabrot::gridSize;
+    int row = cell / Buddhabrot::gridSize;
+    return { -gridExtent + (column + u) * size, (row + v) * size };
+}
+
+// Estimates the points each cell puts into the view from a few jittered
+// orbits, cells are handed out to the threads through `nextCell`.
+void
+estimateImportance(Buddhabrot& self, std::mt19937_64& random)
+{
+    const int probes = 4;
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    int maxLimit = *std::max_element(self.limits.begin(), self.limits.end());
+    int cells = (int)self.importance.size();
+
+    int cell;
+    while ((cell = self.nextCell.fetch_add(1, std::memory_order_relaxed)) <
+           cells) {
+        if (!self.running.load(std::memory_order_relaxed)) {
+            return;
+        }
+
+        int inside = 0;
+        for (int probe = 0; probe < probes; probe++) {
+            Complex c = cellPoint(cell, uniform(random), uniform(random));
+            int iterations = escapeIterations(c, maxLimit);
+            if (channelMask(self.limits, iterations)) {
+                inside +=
+                  traceOrbit(self.view, c, iterations, 0, 0.0f, nullptr);
+            }
+        }
+        self.importance[cell] = (float)inside / probes;
+    }
+}
+
+void
+mergeVisits(Buddhabrot& self, std::vector<Visit>& visits)
+{
+    std::sort(visits.begin(), visits.end(), [](const Visit& a, const Visit& b) {
+        return a.pixel < b.pixel;
+    });
+
+    uint32_t stripePixels = Buddhabrot::stripeRows * self.view.pixelsX;
+    size_t begin = 0;
+    while (begin < visits.size()) {
+        uint32_t stripe = visits[begin].pixel / stripePixels;
+        std::lock_guard<std::mutex> lock(self.stripes[stripe]);
+
+        size_t end = begin;
+        while (end < visits.size() &&
+               visits[end].pixel / stripePixels == stripe) {
+            float* pixel = &self.density[visits[end].pixel * 3];
+            for (int channel = 0; channel < 3; channel++) {
+                if (visits[end].channels & (1u << channel)) {
+                    pixel[channel] += visits[end].weight;
+                }
+            }
+            end++;
+        }
+        begin = end;
+    }
+
+    visits.clear();
+}
+
+void
+run(Buddhabrot* self, int index, int threadCount)
+{
+    std::mt19937_64 random(index * 0x9e3779b97f4a7c15ull + 1);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    estimateImportance(*self, random);
+    self->preparedThreads.fetch_add(1, std::memory_order_acq_rel);
+    while (self->preparedThreads.load(std::memory_order_acquire) <
+           threadCount) {
+        if (!self->running.load(std::memory_order_relaxed)) {
+            return;
+        }
+        std::this_thread::yield();
+    }
+
+    // Cells that missed the view in the pre-pass keep a small share of the
+    // samples, their orbits may still pass through it.
+    std::vector<float> importance = self->importance;
+    double total = 0.0;
+    for (float value : importance) {
+        total += value;
+    }
+    float minimum =
+      total > 0.0 ? (float)(0.01 * total / importance.size()) : 1.0f;
+    std::vector<double> cumulative(importance.size());
+    total = 0.0;
+    for (size_t cell = 0; cell < importance.size(); cell++) {
+        importance[cell] = std::max(importance[cell], minimum);
+        total += importance[cell];
+        cumulative[cell] = total;
+    }
+
+    const size_t batchSize = 1 << 16;
+    std::vector<Visit> visits;
+    visits.reserve(batchSize);
+
+    int maxLimit = *std::max_element(self->limits.begin(), self->limits.end());
+    uint64_t samples = 0;
+
+    while (self->running.load(std::memory_order_relaxed)) {
+        double u = uniform(random) * total;
+        int cell = (int)(std::upper_bound(cumulative.begin(),
+                                          cumulative.end() - 1,
+                                          u) -
+                         cumulative.begin());
+        Complex c = cellPoint(cell, uniform(random), uniform(random));
+
+        int iterations = escapeIterations(c, maxLimit);
+        uint32_t channels = channelMask(self->limits, iterations);
+        if (channels) {
+            // Inverse of the sampling density relative to uniform sampling.
+            float weight =
+              (float)(total / (importance.size() * importance[cell]));
+            traceOrbit(self->view, c, iterations, channels, weight, &visits);
+        }
+
+        samples++;
+        if (visits.size() >= batchSize) {
+            mergeVisits(*self, visits);
+            self->samples.fetch_add(samples, std::memory_order_relaxed);
+            samples = 0;
+        }
+    }
+
+    mergeVisits(*self, visits);
+    self->samples.fetch_add(samples, std::memory_order_relaxed);
+}
+
+}
+
+void
+startBuddhabrot(Buddhabrot& self,
+                const BuddhabrotView& view,
+                const std::array<int, 3>& limits,
+                int threadCount)
+{
+    stopBuddhabrot(self);
+
+    self.view = view;
+    self.limits = limits;
+    self.density.assign((size_t)view.pixelsX * view.pixelsY * 3, 0.0f);
+    int stripeCount =
+      (view.pixelsY + Buddhabrot::stripeRows - 1) / Buddhabrot::stripeRows;
+    if ((int)self.stripes.size() != stripeCount) {
+        self.stripes = std::vector<std::mutex>(stripeCount);
+    }
+
+    self.importance.assign(Buddhabrot::gridSize * Buddhabrot::gridSize / 2,
+                           0.0f);
+    self.nextCell = 0;
+    self.preparedThreads = 0;
+    self.samples = 0;
+
+    self.running = true;
+    for (int index = 0; index < threadCount; index++) {
+        self.threads.emplace_back(run, &self, index, threadCount);
+    }
+}
+
+void
+stopBuddhabrot(Buddhabrot& self)
+{
+    self.running = false;
+    for (std::thread& thread : self.threads) {
+        thread.join();
+    }
+    self.threads.clear();
+}
+
+void
+copyDensity(Buddhabrot& self, std::vector<float>& density)
+{
+    density.resize(self.density.size());
+
+    size_t stripeValues =
+      (size_t)Buddhabrot::stripeRows * self.view.pixelsX * 3;
+    for (size_t stripe = 0; stripe < self.stripes.size(); stripe++) {
+        std::lock_guard<std::mutex> lock(self.stripes[stripe]);
+        size_t begin = stripe * stripeValues;
+        size_t end = std::min(begin + stripeValues, self.density.size());
+        std::copy(self.density.begin() + begin,
+                  self.density.begin() + end,
+                  density.begin() + begin);
+    }
+}
+
+std::array<float, 3>
+densityScale(const std::vector<float>& density)
+{
+    const size_t maxValues = 1 << 16;
+    size_t pixels = density.size() / 3;
+    size_t stride = std::max<size_t>(1, pixels / maxValues);
+
+    std::array<float, 3> result;
+    std::vector<float> values;
+    for (int channel = 0; channel < 3; channel++) {
+        values.clear();
+        for (size_t pixel = 0; pixel < pixels; pixel += stride) {
+            float value = density[pixel * 3 + channel];
+            if (value > 0.0f) {
+                values.push_back(value);
+            }
+        }
+
+        if (values.empty()) {
+            result[channel] = 1.0f;
+            continue;
+        }
+
+        auto percentile = values.begin() + (values.size() - 1) * 995 / 1000;
+        std::nth_element(values.begin(), percentile, values.end());
+        result[channel] = 1.0f / *percentile;
+    }
+    return result;
+}
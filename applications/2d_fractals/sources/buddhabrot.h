@@ -0,0 +1,79 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Rectangle of the complex plane covered by the density image. Pixel (0, 0) is
+// the bottom left corner, like `gl_FragCoord`.
+struct BuddhabrotView
+{
+    double left = 0.0;
+    double bottom = 0.0;
+    double width = 0.0;
+    double height = 0.0;
+    int pixelsX = 0;
+    int pixelsY = 0;
+
+    bool operator==(const BuddhabrotView& other) const
+    {
+        return left == other.left && bottom == other.bottom &&
+               width == other.width && height == other.height &&
+               pixelsX == other.pixelsX && pixelsY == other.pixelsY;
+    }
+};
+
+// Orbit density of the points outside the Mandelbrot set, accumulated by
+// worker threads until stopped. A channel counts the orbits that escape within
+// its iteration limit. Equal limits give the Buddhabrot, and limits that
+// decrease from red to blue give the Nebulabrot.
+//
+// Every thread first helps with a coarse pre-pass that estimates how much each
+// cell of the sampling grid contributes to the view. After that, `c` values
+// are drawn proportionally to that estimate and weighted by the inverse, so
+// the result still converges to the uniformly sampled image. Threads buffer
+// their visits and merge them sorted by pixel, locking one band of rows at a
+// time. Readers therefore only contend with writers of the same band.
+struct Buddhabrot
+{
+    BuddhabrotView view;
+    std::array<int, 3> limits = { 0, 0, 0 };
+
+    // RGB density, one mutex per `stripeRows` rows.
+    static constexpr int stripeRows = 16;
+    std::vector<float> density;
+    std::vector<std::mutex> stripes;
+
+    // Contribution estimate of each cell of the sampling grid, which covers
+    // the upper half of [-2, 2]x[-2, 2]. The lower half is its mirror image.
+    static constexpr int gridSize = 128;
+    std::vector<float> importance;
+    std::atomic<int> nextCell{ 0 };
+    std::atomic<int> preparedThreads{ 0 };
+
+    std::atomic<uint64_t> samples{ 0 };
+    std::atomic<bool> running{ false };
+    std::vector<std::thread> threads;
+};
+
+// Clears the density and starts sampling `view` on `threadCount` threads.
+void
+startBuddhabrot(Buddhabrot& self,
+                const BuddhabrotView& view,
+                const std::array<int, 3>& limits,
+                int threadCount);
+
+void
+stopBuddhabrot(Buddhabrot& self);
+
+// Copies the density while the threads keep sampling.
+void
+copyDensity(Buddhabrot& self, std::vector<float>& density);
+
+// Per-channel factor that maps a high percentile of the nonzero densities to
+// 1, so that a few hot pixels do not darken the rest of the image.
+std::array<float, 3>
+densityScale(const std::vector<float>& density);
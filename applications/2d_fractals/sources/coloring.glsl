@@ -0,0 +1,43 @@
+// Maps smooth iteration counts to colors, shared by the shaders that color
+// the iteration buffer. Included with `#include "coloring.glsl"` after the
+// version line.
+
+#define COLORING_LINEAR 0
+#define COLORING_CYCLIC 1
+#define COLORING_HISTOGRAM 2
+
+#define HISTOGRAM_BINS 1024
+#define CYCLIC_PERIOD 32.0
+
+uniform sampler2D palette;
+uniform sampler2D cdf;
+uniform int coloring;
+uniform vec3 interiorColor;
+
+// Color of a pixel with the smooth iteration count `n`, -1 inside the set.
+vec3
+colorIterations(float n, int jumps)
+{
+    if (n < 0.0) {
+        return interiorColor;
+    }
+
+    float t;
+    if (coloring == COLORING_CYCLIC) {
+        t = fract(n / CYCLIC_PERIOD);
+    } else if (coloring == COLORING_HISTOGRAM) {
+        // The CDF texel `k` holds the fraction of escaped pixels in bins 0..k.
+        float bin = n / float(jumps + 2) * float(HISTOGRAM_BINS);
+        t = texture(cdf, vec2(bin / float(HISTOGRAM_BINS), 0.5)).r;
+    } else {
+        t = n / float(jumps);
+    }
+
+    if (coloring != COLORING_CYCLIC) {
+        // Keep linear filtering from wrapping around the palette ends.
+        float texel = 0.5 / float(textureSize(palette, 0).x);
+        t = clamp(t, texel, 1.0 - texel);
+    }
+
+    return texture(palette, vec2(t, 0.5)).rgb;
+}
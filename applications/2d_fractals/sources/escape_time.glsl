@@ -0,0 +1,101 @@
+// Escape time iteration shared by the shaders that evaluate the Mandelbrot
+// set. Included with `#include "escape_time.glsl"` after the version line.
+
+vec2
+multiplyComplex(vec2 a, vec2 b)
+{
+    return vec2(a.x * b.x - a.y * b.y, a.x * b.y + a.y * b.x);
+}
+
+// Analytic test for the two largest components of the set: the main cardioid
+// and the period-2 bulb centered at -1.
+bool
+isInsideMainComponents(vec2 c)
+{
+    float y2 = c.y * c.y;
+
+    float q = (c.x - 0.25) * (c.x - 0.25) + y2;
+    if (q * (q + (c.x - 0.25)) <= 0.25 * y2) {
+        return true;
+    }
+
+    return (c.x + 1.0) * (c.x + 1.0) + y2 <= 0.0625;
+}
+
+// Continuous iteration count of an orbit that escaped at iteration `i`, lies in
+// (i, i + 1].
+float
+smoothIterations(int i, vec2 z)
+{
+    return float(i) + 1.0 - log2(log(length(z)) / log(10.0));
+}
+
+// Returns the smooth escape iteration, or -1 when `c` is in the set.
+float
+escapeTime(vec2 c, int jumps)
+{
+    vec2 z = vec2(0.0, 0.0);
+
+    for (int i = 0; i <= jumps; i++) {
+        z = multiplyComplex(z, z) + c;
+        if (length(z) >= 10.0) {
+            return smoothIterations(i, z);
+        }
+    }
+
+    return -1.0;
+}
+
+// Same as `escapeTime`, but skips the main cardioid and period-2 bulb and
+// stops as soon as the orbit is found to be cycling (Brent's algorithm: the
+// orbit is compared against a checkpoint that is moved forward every time the
+// search window doubles).
+float
+escapeTimeOptimized(vec2 c, float tolerance, int jumps)
+{
+    if (isInsideMainComponents(c)) {
+        return -1.0;
+    }
+
+    vec2 z = vec2(0.0, 0.0);
+
+    vec2 checkpoint = z;
+    int checkpointWindow = 1;
+    int checkpointSteps = 0;
+
+    for (int i = 0; i <= jumps; i++) {
+        z = multiplyComplex(z, z) + c;
+        if (dot(z, z) >= 100.0) {
+            return smoothIterations(i, z);
+        }
+
+        vec2 difference = abs(z - checkpoint);
+        if (max(difference.x, difference.y) < tolerance) {
+            return -1.0;
+        }
+
+        checkpointSteps++;
+        if (checkpointSteps == checkpointWindow) {
+            checkpointSteps = 0;
+            checkpointWindow *= 2;
+            checkpoint = z;
+        }
+    }
+
+    return -1.0;
+}
+
+// Escape time of the Julia set of `c` at the point `z`: same iteration with
+// the orbit starting at the point instead of at zero.
+float
+escapeTimeJulia(vec2 z, vec2 c, int jumps)
+{
+    for (int i = 0; i <= jumps; i++) {
+        z = multiplyComplex(z, z) + c;
+        if (dot(z, z) >= 100.0) {
+            return smoothIterations(i, z);
+        }
+    }
+
+    return -1.0;
+}
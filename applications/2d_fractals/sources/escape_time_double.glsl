@@ -0,0 +1,85 @@
+// Double precision overloads of the functions of `escape_time.glsl`, needs
+// `GL_ARB_gpu_shader_fp64`. The orbit is only converted back to single
+// precision for the smooth iteration count, once it escaped.
+
+dvec2
+multiplyComplex(dvec2 a, dvec2 b)
+{
+    return dvec2(a.x * b.x - a.y * b.y, a.x * b.y + a.y * b.x);
+}
+
+bool
+isInsideMainComponents(dvec2 c)
+{
+    double y2 = c.y * c.y;
+
+    double q = (c.x - 0.25LF) * (c.x - 0.25LF) + y2;
+    if (q * (q + (c.x - 0.25LF)) <= 0.25LF * y2) {
+        return true;
+    }
+
+    return (c.x + 1.0LF) * (c.x + 1.0LF) + y2 <= 0.0625LF;
+}
+
+float
+escapeTime(dvec2 c, int jumps)
+{
+    dvec2 z = dvec2(0.0LF, 0.0LF);
+
+    for (int i = 0; i <= jumps; i++) {
+        z = multiplyComplex(z, z) + c;
+        if (dot(z, z) >= 100.0LF) {
+            return smoothIterations(i, vec2(z));
+        }
+    }
+
+    return -1.0;
+}
+
+float
+escapeTimeOptimized(dvec2 c, double tolerance, int jumps)
+{
+    if (isInsideMainComponents(c)) {
+        return -1.0;
+    }
+
+    dvec2 z = dvec2(0.0LF, 0.0LF);
+
+    dvec2 checkpoint = z;
+    int checkpointWindow = 1;
+    int checkpointSteps = 0;
+
+    for (int i = 0; i <= jumps; i++) {
+        z = multiplyComplex(z, z) + c;
+        if (dot(z, z) >= 100.0LF) {
+            return smoothIterations(i, vec2(z));
+        }
+
+        dvec2 difference = abs(z - checkpoint);
+        if (max(difference.x, difference.y) < tolerance) {
+            return -1.0;
+        }
+
+        checkpointSteps++;
+        if (checkpointSteps == checkpointWindow) {
+            checkpointSteps = 0;
+            checkpointWindow *= 2;
+            checkpoint = z;
+        }
+    }
+
+    return -1.0;
+}
+
+float
+escapeTimeJulia(dvec2 z, dvec2 c, int jumps)
+{
+    for (int i = 0; i <= jumps; i++) {
+        z = multiplyComplex(z, z) + c;
+        if (dot(z, z) >= 100.0LF) {
+            return smoothIterations(i, vec2(z));
+        }
+    }
+
+    return -1.0;
+}
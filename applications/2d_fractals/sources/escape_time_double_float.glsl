@@ -0,0 +1,170 @@
+// Escape time in double-float arithmetic: a number is the unevaluated sum of
+// two floats (high, low), which carries about 48 bits of mantissa on hardware
+// without `GL_ARB_gpu_shader_fp64`. A complex number is a `vec4` holding the
+// pairs of its real and imaginary parts, (x.high, x.low, y.high, y.low).
+//
+// The error-free transformations below rely on every float operation being
+// rounded exactly as written. Compilers simplify `(a + b) - a` to `b` unless
+// the results are `precise`, which needs `GL_ARB_gpu_shader5` before GLSL 4.
+// Without it the rounded results are multiplied by `one`, which the host sets
+// to 1 and the compiler cannot see through.
+
+#if defined(GL_ARB_gpu_shader5)
+#define EXACT precise
+#else
+#define EXACT
+#endif
+
+uniform float one;
+
+// Sum of two floats as a pair.
+vec2
+twoSum(float a, float b)
+{
+    EXACT float s = (a + b) * one;
+    EXACT float v = s - a;
+    EXACT float e = (a - (s - v)) + (b - v);
+    return vec2(s, e);
+}
+
+// Same as `twoSum` when |a| >= |b|.
+vec2
+quickTwoSum(float a, float b)
+{
+    EXACT float s = (a + b) * one;
+    EXACT float e = b - (s - a);
+    return vec2(s, e);
+}
+
+// Splits a float into two halves of 12 bits whose products are exact
+// (Dekker), GLSL 3.30 has no fused multiply-add.
+vec2
+splitFloat(float a)
+{
+    const float splitter = 4097.0; // 2^12 + 1
+    EXACT float t = a * splitter * one;
+    EXACT float high = t - (t - a) * one;
+    return vec2(high, a - high);
+}
+
+// Product of two floats as a pair.
+vec2
+twoProduct(float a, float b)
+{
+    EXACT float p = a * b * one;
+    vec2 x = splitFloat(a);
+    vec2 y = splitFloat(b);
+    EXACT float e = ((x.x * y.x - p) + x.x * y.y + x.y * y.x) + x.y * y.y;
+    return vec2(p, e);
+}
+
+vec2
+addDoubleFloat(vec2 a, vec2 b)
+{
+    vec2 s = twoSum(a.x, b.x);
+    s.y += a.y + b.y;
+    return quickTwoSum(s.x, s.y);
+}
+
+vec2
+multiplyDoubleFloat(vec2 a, vec2 b)
+{
+    vec2 p = twoProduct(a.x, b.x);
+    p.y += a.x * b.y + a.y * b.x;
+    return quickTwoSum(p.x, p.y);
+}
+
+// z^2 + c, doubling a pair is exact.
+vec4
+squareAddComplex(vec4 z, vec4 c)
+{
+    vec2 x2 = multiplyDoubleFloat(z.xy, z.xy);
+    vec2 y2 = multiplyDoubleFloat(z.zw, z.zw);
+    vec2 xy = multiplyDoubleFloat(z.xy, z.zw);
+    return vec4(addDoubleFloat(addDoubleFloat(x2, -y2), c.xy),
+                addDoubleFloat(2.0 * xy, c.zw));
+}
+
+bool
+isInsideMainComponents(vec4 c)
+{
+    vec2 y2 = multiplyDoubleFloat(c.zw, c.zw);
+
+    vec2 x = addDoubleFloat(c.xy, vec2(-0.25, 0.0));
+    vec2 q = addDoubleFloat(multiplyDoubleFloat(x, x), y2);
+    vec2 cardioid = multiplyDoubleFloat(q, addDoubleFloat(q, x));
+    vec2 bound = addDoubleFloat(cardioid, -0.25 * y2);
+    if (bound.x + bound.y <= 0.0) {
+        return true;
+    }
+
+    x = addDoubleFloat(c.xy, vec2(1.0, 0.0));
+    vec2 bulb =
+      addDoubleFloat(addDoubleFloat(multiplyDoubleFloat(x, x), y2),
+                     vec2(-0.0625, 0.0));
+    return bulb.x + bulb.y <= 0.0;
+}
+
+float
+escapeTimeDoubleFloat(vec4 c, int jumps)
+{
+    vec4 z = vec4(0.0);
+
+    for (int i = 0; i <= jumps; i++) {
+        z = squareAddComplex(z, c);
+        if (dot(z.xz, z.xz) >= 100.0) {
+            return smoothIterations(i, z.xz);
+        }
+    }
+
+    return -1.0;
+}
+
+float
+escapeTimeDoubleFloatOptimized(vec4 c, float tolerance, int jumps)
+{
+    if (isInsideMainComponents(c)) {
+        return -1.0;
+    }
+
+    vec4 z = vec4(0.0);
+
+    vec4 checkpoint = z;
+    int checkpointWindow = 1;
+    int checkpointSteps = 0;
+
+    for (int i = 0; i <= jumps; i++) {
+        z = squareAddComplex(z, c);
+        if (dot(z.xz, z.xz) >= 100.0) {
+            return smoothIterations(i, z.xz);
+        }
+
+        vec2 differenceX = addDoubleFloat(z.xy, -checkpoint.xy);
+        vec2 differenceY = addDoubleFloat(z.zw, -checkpoint.zw);
+        if (max(abs(differenceX.x), abs(differenceY.x)) < tolerance) {
+            return -1.0;
+        }
+
+        checkpointSteps++;
+        if (checkpointSteps == checkpointWindow) {
+            checkpointSteps = 0;
+            checkpointWindow *= 2;
+            checkpoint = z;
+        }
+    }
+
+    return -1.0;
+}
+
+float
+escapeTimeDoubleFloatJulia(vec4 z, vec4 c, int jumps)
+{
+    for (int i = 0; i <= jumps; i++) {
+        z = squareAddComplex(z, c);
+        if (dot(z.xz, z.xz) >= 100.0) {
+            return smoothIterations(i, z.xz);
+        }
+    }
+
+    return -1.0;
+}
@@ -0,0 +1,15 @@
+#version 330 core
+
+uniform sampler2D density;
+uniform vec3 scale;
+
+out vec4 returnColor;
+
+void
+main()
+{
+    vec3 value = texelFetch(density, ivec2(gl_FragCoord.xy), 0).rgb;
+
+    // The square root keeps the faint outer orbits visible.
+    returnColor = vec4(sqrt(min(value * scale, vec3(1.0))), 1.0);
+}
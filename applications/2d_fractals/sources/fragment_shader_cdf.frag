@@ -0,0 +1,26 @@
+#version 330 core
+
+#define HISTOGRAM_BINS 1024
+
+uniform sampler2D histogram;
+
+out float returnFraction;
+
+// Prefix sum of the histogram, normalized by the number of escaped pixels.
+void
+main()
+{
+    int bin = int(gl_FragCoord.x);
+
+    float partial = 0.0;
+    float total = 0.0;
+    for (int i = 0; i < HISTOGRAM_BINS; i++) {
+        float count = texelFetch(histogram, ivec2(i, 0), 0).r;
+        total += count;
+        if (i <= bin) {
+            partial += count;
+        }
+    }
+
+    returnFraction = total > 0.0 ? partial / total : 0.0;
+}
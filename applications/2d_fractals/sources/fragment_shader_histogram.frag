@@ -0,0 +1,9 @@
+#version 330 core
+
+out float returnCount;
+
+void
+main()
+{
+    returnCount = 1.0;
+}
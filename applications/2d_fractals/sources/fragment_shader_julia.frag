@@ -0,0 +1,16 @@
+#version 330 core
+
+#include "escape_time.glsl"
+
+uniform int jumps;
+
+in vec2 point;
+flat in vec2 juliaC;
+
+out float returnIterations;
+
+void
+main()
+{
+    returnIterations = escapeTimeJulia(point, juliaC, jumps);
+}
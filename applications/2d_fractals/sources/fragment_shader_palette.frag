@@ -0,0 +1,15 @@
+#version 330 core
+
+#include "coloring.glsl"
+
+uniform sampler2D iterations;
+uniform int jumps;
+
+out vec4 returnColor;
+
+void
+main()
+{
+    float n = texelFetch(iterations, ivec2(gl_FragCoord.xy), 0).r;
+    returnColor = vec4(colorIterations(n, jumps), 1.0);
+}
@@ -0,0 +1,30 @@
+#version 330 core
+
+#include "view.glsl"
+#include "coloring.glsl"
+
+uniform int sampleGrid; // Samples per pixel along each axis.
+
+flat in ivec2 refinedPixel;
+
+out vec4 returnColor;
+
+// Average color of a grid of samples spread over the pixel, mapped with the
+// same view as `fragment_shader.frag`.
+void
+main()
+{
+    float tolerance = min(1e-6, pixelSize() * 1e-3 / float(sampleGrid));
+
+    vec3 color = vec3(0.0);
+    for (int y = 0; y < sampleGrid; y++) {
+        for (int x = 0; x < sampleGrid; x++) {
+            vec2 position =
+              vec2(refinedPixel) + (vec2(x, y) + 0.5) / float(sampleGrid);
+            float n = escapeTimeAt(position, tolerance);
+            color += colorIterations(n, jumps);
+        }
+    }
+
+    returnColor = vec4(color / float(sampleGrid * sampleGrid), 1.0);
+}
@@ -0,0 +1,13 @@
+#version 330 core
+
+uniform sampler2D refined;
+
+flat in ivec2 packedTexel;
+
+out vec4 returnColor;
+
+void
+main()
+{
+    returnColor = texelFetch(refined, packedTexel, 0);
+}
@@ -0,0 +1,17 @@
+#version 330 core
+
+#include "coloring.glsl"
+
+uniform sampler2D iterations; // The atlas of thumbnails
+uniform int jumps;
+
+in vec2 texel;
+
+out vec4 returnColor;
+
+void
+main()
+{
+    float n = texelFetch(iterations, ivec2(texel), 0).r;
+    returnColor = vec4(colorIterations(n, jumps), 1.0);
+}
@@ -1,9 +1,19 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
 #include <fstream>
 #include <iostream>
+#include <map>
 #include <sstream>
+#include <tuple>
+#include <vector>
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#include <png.h>
+
+#include "buddhabrot.h"
 
 std::string
 readFile(const std::string& filePath)
@@ -14,6 +24,47 @@ readFile(const std::string& filePath)
     return stringStream.str();
 }
 
+// Reads a shader and inlines the files of its `#include "file"` lines.
+std::string
+readShader(const std::string& filePath)
+{
+    std::ifstream fileStream(filePath);
+    std::stringstream stringStream;
+    std::string line;
+    while (std::getline(fileStream, line)) {
+        if (line.rfind("#include \"", 0) == 0) {
+            size_t begin = line.find('"') + 1;
+            size_t end = line.rfind('"');
+            stringStream << readShader(line.substr(begin, end - begin));
+        } else {
+            stringStream << line << '\n';
+        }
+    }
+    return stringStream.str();
+}
+
+// Precision tiers of the escape time iteration, see `view.glsl`.
+enum Precision
+{
+    SinglePrecision,
+    DoubleFloatPrecision,
+    DoublePrecision,
+};
+
+const char* precisionNames[] = { "single", "double-float", "double" };
+
+// Reads a shader including `view.glsl` and selects the tier by defining its
+// macro after the version line.
+std::string
+readViewShader(const std::string& filePath, Precision precision)
+{
+    const char* defines[] = { "",
+                              "#define PRECISION_DOUBLE_FLOAT\n",
+                              "#define PRECISION_DOUBLE\n" };
+    std::string source = readShader(filePath);
+    return source.insert(source.find('\n') + 1, defines[precision]);
+}
+
 GLuint
 compileShader(GLenum shaderType, const std::string& shaderSource)
 {
@@ -60,6 +111,160 @@ createShaderProgram(const std::string& vertexShaderSource,
     return shaderProgram;
 }
 
+// Program without a fragment stage whose geometry shader output `pixel` is
+// captured with transform feedback.
+GLuint
+createCompactionProgram(const std::string& vertexShaderSource,
+                        const std::string& geometryShaderSource)
+{
+    GLuint vertexShader = compileShader(GL_VERTEX_SHADER, vertexShaderSource);
+    GLuint geometryShader =
+      compileShader(GL_GEOMETRY_SHADER, geometryShaderSource);
+
+    GLuint shaderProgram = glCreateProgram();
+    glAttachShader(shaderProgram, vertexShader);
+    glAttachShader(shaderProgram, geometryShader);
+    const char* varyings[] = { "pixel" };
+    glTransformFeedbackVaryings(
+      shaderProgram, 1, varyings, GL_INTERLEAVED_ATTRIBS);
+    glLinkProgram(shaderProgram);
+
+    GLint success;
+    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
+    if (!success) {
+        GLchar infoLog[512];
+        glGetProgramInfoLog(shaderProgram, 512, nullptr, infoLog);
+        std::cerr << "Shader program linking error: " << infoLog << std::endl;
+    }
+
+    glDeleteShader(vertexShader);
+    glDeleteShader(geometryShader);
+
+    return shaderProgram;
+}
+
+struct RenderTarget
+{
+    GLuint texture = 0;
+    GLuint framebuffer = 0;
+    int width = 0;
+    int height = 0;
+};
+
+// Creates a texture with a framebuffer rendering into it.
+RenderTarget
+createRenderTarget(int width, int height, GLenum internalFormat)
+{
+    RenderTarget target;
+    target.width = width;
+    target.height = height;
+
+    glGenTextures(1, &target.texture);
+    glBindTexture(GL_TEXTURE_2D, target.texture);
+    glTexImage2D(GL_TEXTURE_2D,
+                 0,
+                 internalFormat,
+                 width,
+                 height,
+                 0,
+                 GL_RED,
+                 GL_FLOAT,
+                 nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glGenFramebuffers(1, &target.framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, target.framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER,
+                           GL_COLOR_ATTACHMENT0,
+                           GL_TEXTURE_2D,
+                           target.texture,
+                           0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Framebuffer is incomplete" << std::endl;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    return target;
+}
+
+void
+deleteRenderTarget(RenderTarget& target)
+{
+    glDeleteFramebuffers(1, &target.framebuffer);
+    glDeleteTextures(1, &target.texture);
+    target = RenderTarget{};
+}
+
+using Color = std::array<float, 3>;
+
+struct Palette
+{
+    const char* name;
+    std::vector<Color> stops;
+    Color interior;
+};
+
+// Cyclic palettes repeat their first stop at the end so that wrapping around
+// is seamless.
+std::vector<Palette> palettes = {
+    { "Red", { { 0, 0, 0 }, { 1, 0, 0 } }, { 1, 0, 0 } },
+    { "Fire",
+      { { 0, 0, 0 }, { 0.5, 0, 0 }, { 1, 0.5, 0 }, { 1, 1, 0.25 }, { 1, 1, 1 } },
+      { 0, 0, 0 } },
+    { "Ocean",
+      { { 0, 0.03, 0.4 },
+        { 0.1, 0.4, 0.8 },
+        { 0.9, 1, 1 },
+        { 1, 0.7, 0 },
+        { 0, 0.03, 0.4 } },
+      { 0, 0, 0 } },
+    { "Grayscale", { { 0, 0, 0 }, { 1, 1, 1 } }, { 0, 0, 0 } },
+};
+
+const char* coloringNames[] = { "linear", "cyclic", "histogram" };
+
+// Samples the palette gradient into a 256x1 texture.
+GLuint
+createPaletteTexture(const Palette& palette)
+{
+    int size = 256;
+    std::vector<unsigned char> pixels(size * 3);
+    for (int i = 0; i < size; i++) {
+        float t = (float)i / (size - 1) * (palette.stops.size() - 1);
+        int stop = std::min((int)t, (int)palette.stops.size() - 2);
+        float fraction = t - stop;
+        for (int channel = 0; channel < 3; channel++) {
+            float a = palette.stops[stop][channel];
+            float b = palette.stops[stop + 1][channel];
+            pixels[i * 3 + channel] =
+              (unsigned char)std::lround((a + (b - a) * fraction) * 255.0f);
+        }
+    }
+
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D,
+                 0,
+                 GL_RGB8,
+                 size,
+                 1,
+                 0,
+                 GL_RGB,
+                 GL_UNSIGNED_BYTE,
+                 pixels.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    return texture;
+}
+
 float quadVertices[] = { -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, -1.0f,
                          -1.0f, 1.0f, 1.0f,  -1.0f, 1.0f, 1.0f };
 
@@ -67,6 +272,55 @@ double offsetX = 0.0f;
 double offsetY = 0.0f;
 double zoom = 1.0f;
 
+bool optimized = true;
+bool benchmarkRequested = false;
+
+// Tier of the current view. Floats have 24 bits of mantissa and stop
+// resolving pixels around 1e-6 near the set, double-floats (about 48 bits) and
+// doubles (53 bits) go on to about 1e-13 and 1e-15.
+Precision precision = SinglePrecision;
+const double singlePrecisionPixel = 1e-6;
+
+int palette = 0;
+int coloring = 0;
+
+// Set whenever the view changes; recoloring alone never recomputes iterations.
+bool iterationsDirty = true;
+
+// Adaptive antialiasing: pixels whose color differs from a neighbor by more
+// than `edgeContrast` are recomputed with `sampleGrid`^2 samples.
+bool antialiasing = true;
+bool refinementDirty = true;
+const int sampleGrid = 4;
+const float edgeContrast = 1.0f / 32.0f;
+
+const int histogramBins = 1024;
+
+// Orbit density mode, sampled on the CPU while the preview refreshes.
+bool buddhabrotMode = false;
+bool nebulabrot = false;
+bool buddhabrotSaveRequested = false;
+const double buddhabrotPreviewInterval = 0.25;
+
+// Julia explorer: a grid of thumbnails of the Julia sets whose parameters are
+// the centers of `juliaColumns` x `juliaRows` cells of the view. Panning and
+// zooming browse the parameters, a click opens the Julia set of a cell in the
+// main view.
+bool juliaExplorer = false;
+bool juliaSelectRequested = false;
+double juliaSelectX = 0.0;
+double juliaSelectY = 0.0;
+const int juliaColumns = 16;
+const int juliaRows = 16;
+const int juliaThumbnailJumps = 200;
+const float juliaRadius = 1.6f;
+
+// The main view shows the Julia set of `juliaC`, the Mandelbrot view (offsets
+// and zoom) is restored when going back to the explorer.
+bool julia = false;
+std::array<double, 2> juliaC = {};
+std::array<double, 3> mandelbrotView = {};
+
 void
 cursorPositionCallback(GLFWwindow* window, double xPosition, double yPosition)
 {
@@ -76,6 +330,7 @@ cursorPositionCallback(GLFWwindow* window, double xPosition, double yPosition)
     if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS) {
         offsetX -= (xPosition - lastPositionX) * zoom;
         offsetY += (yPosition - lastPositionY) * zoom;
+        iterationsDirty = true;
     }
 
     lastPositionX = xPosition;
@@ -86,6 +341,986 @@ void
 scrollCallback(GLFWwindow* window, double xOffset, double yOffset)
 {
     zoom += yOffset * 0.05f * zoom;
+    iterationsDirty = true;
+}
+
+void
+keyCallback(GLFWwindow* window, int key, int scancode, int action, int mode)
+{
+    if (action != GLFW_PRESS)
+        return;
+
+    if (key == GLFW_KEY_O) {
+        optimized = !optimized;
+        iterationsDirty = true;
+        std::cout << "Optimized escape time: " << (optimized ? "on" : "off")
+                  << std::endl;
+    } else if (key == GLFW_KEY_K) {
+        benchmarkRequested = true;
+    } else if (key == GLFW_KEY_P) {
+        palette = (palette + 1) % palettes.size();
+        refinementDirty = true;
+        std::cout << "Palette: " << palettes[palette].name << std::endl;
+    } else if (key == GLFW_KEY_H) {
+        coloring = (coloring + 1) % 3;
+        refinementDirty = true;
+        std::cout << "Coloring: " << coloringNames[coloring] << std::endl;
+    } else if (key == GLFW_KEY_B) {
+        buddhabrotMode = !buddhabrotMode;
+        iterationsDirty = true;
+        std::cout << "Buddhabrot: " << (buddhabrotMode ? "on" : "off")
+                  << std::endl;
+    } else if (key == GLFW_KEY_N) {
+        nebulabrot = !nebulabrot;
+        std::cout << "Nebulabrot: " << (nebulabrot ? "on" : "off")
+                  << std::endl;
+    } else if (key == GLFW_KEY_S) {
+        buddhabrotSaveRequested = true;
+    } else if (key == GLFW_KEY_X) {
+        antialiasing = !antialiasing;
+        refinementDirty = true;
+        std::cout << "Adaptive antialiasing: " << (antialiasing ? "on" : "off")
+                  << std::endl;
+    } else if (key == GLFW_KEY_J) {
+        if (julia) {
+            julia = false;
+            offsetX = mandelbrotView[0];
+            offsetY = mandelbrotView[1];
+            zoom = mandelbrotView[2];
+            juliaExplorer = true;
+        } else {
+            juliaExplorer = !juliaExplorer;
+        }
+        iterationsDirty = true;
+        std::cout << "Julia explorer: " << (juliaExplorer ? "on" : "off")
+                  << std::endl;
+    }
+}
+
+// A click that does not drag picks the thumbnail under the cursor in the
+// Julia explorer.
+void
+mouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
+{
+    static double pressX = 0.0;
+    static double pressY = 0.0;
+
+    if (button != GLFW_MOUSE_BUTTON_LEFT || !juliaExplorer) {
+        return;
+    }
+
+    double x, y;
+    glfwGetCursorPos(window, &x, &y);
+    if (action == GLFW_PRESS) {
+        pressX = x;
+        pressY = y;
+    } else if (action == GLFW_RELEASE && x == pressX && y == pressY) {
+        juliaSelectRequested = true;
+        juliaSelectX = x;
+        juliaSelectY = y;
+    }
+}
+
+// Iteration limit for the current zoom depth: 500 iterations at the initial
+// view and 100 more for every halving of the view.
+int
+jumpsForZoom(double zoom)
+{
+    double depth = std::max(0.0, -std::log2(zoom));
+    return std::min(500 + (int)(100.0 * depth), 20000);
+}
+
+// Cheapest tier whose precision covers the pixels of the view. Double
+// precision is preferred over double-float when the GPU supports it.
+Precision
+precisionForZoom(double zoom, int screenWidth, bool doubleSupported)
+{
+    double pixelSize = zoom / screenWidth;
+    if (pixelSize >= singlePrecisionPixel) {
+        return SinglePrecision;
+    }
+    return doubleSupported ? DoublePrecision : DoubleFloatPrecision;
+}
+
+// High and low floats whose sum is `value` to about 48 bits.
+std::array<float, 2>
+splitDouble(double value)
+{
+    float high = (float)value;
+    return { high, (float)(value - high) };
+}
+
+// Sets the uniforms of `view.glsl` for the current tier, the view is computed
+// in double precision and only rounded to what the tier carries.
+void
+setUniforms(GLuint shaderProgram, int screenWidth, int screenHeight)
+{
+    glUseProgram(shaderProgram);
+
+    GLint screenSizeLocation =
+      glGetUniformLocation(shaderProgram, "screenSize");
+    glUniform2f(screenSizeLocation, (float)screenWidth, (float)screenHeight);
+
+    double cornerX = 0.5 - 0.5 * zoom + offsetX / screenWidth;
+    double cornerY = 0.5 - 0.5 * zoom + offsetY / screenHeight;
+    double stepX = zoom / screenWidth;
+    double stepY = zoom / screenHeight;
+
+    GLint cornerLocation = glGetUniformLocation(shaderProgram, "viewCorner");
+    GLint stepLocation = glGetUniformLocation(shaderProgram, "viewStep");
+    GLint juliaCLocation = glGetUniformLocation(shaderProgram, "juliaC");
+    if (precision == DoublePrecision) {
+        glUniform2d(cornerLocation, cornerX, cornerY);
+        glUniform2d(stepLocation, stepX, stepY);
+        glUniform2d(juliaCLocation, juliaC[0], juliaC[1]);
+    } else if (precision == DoubleFloatPrecision) {
+        std::array<float, 2> x = splitDouble(cornerX);
+        std::array<float, 2> y = splitDouble(cornerY);
+        glUniform4f(cornerLocation, x[0], x[1], y[0], y[1]);
+        x = splitDouble(stepX);
+        y = splitDouble(stepY);
+        glUniform4f(stepLocation, x[0], x[1], y[0], y[1]);
+        x = splitDouble(juliaC[0]);
+        y = splitDouble(juliaC[1]);
+        glUniform4f(juliaCLocation, x[0], x[1], y[0], y[1]);
+    } else {
+        glUniform2f(cornerLocation, (float)cornerX, (float)cornerY);
+        glUniform2f(stepLocation, (float)stepX, (float)stepY);
+        glUniform2f(juliaCLocation, (float)juliaC[0], (float)juliaC[1]);
+    }
+    glUniform1i(glGetUniformLocation(shaderProgram, "julia"), julia);
+
+    GLint jumpsLocation = glGetUniformLocation(shaderProgram, "jumps");
+    glUniform1i(jumpsLocation, jumpsForZoom(zoom));
+
+    GLint optimizedLocation = glGetUniformLocation(shaderProgram, "optimized");
+    glUniform1i(optimizedLocation, optimized);
+
+    // Keeps the double-float arithmetic from being folded, see
+    // `escape_time_double_float.glsl`.
+    glUniform1f(glGetUniformLocation(shaderProgram, "one"), 1.0f);
+}
+
+// Renders the current view a number of times and returns the average GPU time
+// of a frame in milliseconds.
+double
+measureFrameTime(GLuint shaderProgram, GLuint quadVAO, int frames)
+{
+    GLuint query;
+    glGenQueries(1, &query);
+
+    double total = 0.0;
+    for (int frame = 0; frame < frames; frame++) {
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        glUseProgram(shaderProgram);
+        glBindVertexArray(quadVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+        glEndQuery(GL_TIME_ELAPSED);
+
+        GLuint64 elapsed;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+        total += (double)elapsed;
+    }
+
+    glDeleteQueries(1, &query);
+
+    return total / frames / 1e6;
+}
+
+// Compares the brute-force escape loop against the optimized one on the
+// current view.
+void
+benchmark(GLuint shaderProgram,
+          GLuint quadVAO,
+          const RenderTarget& iterationTarget,
+          int screenWidth,
+          int screenHeight)
+{
+    int frames = 20;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, iterationTarget.framebuffer);
+    glViewport(0, 0, iterationTarget.width, iterationTarget.height);
+    bool wasOptimized = optimized;
+
+    optimized = false;
+    setUniforms(shaderProgram, screenWidth, screenHeight);
+    double bruteForce = measureFrameTime(shaderProgram, quadVAO, frames);
+
+    optimized = true;
+    setUniforms(shaderProgram, screenWidth, screenHeight);
+    double optimizedTime = measureFrameTime(shaderProgram, quadVAO, frames);
+
+    optimized = wasOptimized;
+    iterationsDirty = true;
+
+    std::cout << "Benchmark (" << screenWidth << "x" << screenHeight
+              << ", zoom " << zoom << ", " << jumpsForZoom(zoom)
+              << " jumps): brute force " << bruteForce << " ms, optimized "
+              << optimizedTime << " ms, speedup "
+              << bruteForce / optimizedTime << "x" << std::endl;
+}
+
+// Measures every tier available on the current view. Single precision draws
+// wrong pixels once zoomed in, but still shows what the others cost.
+void
+benchmarkPrecision(const std::array<GLuint, 3>& shaderPrograms,
+                   GLuint quadVAO,
+                   const RenderTarget& iterationTarget,
+                   int screenWidth,
+                   int screenHeight)
+{
+    int frames = 5;
+    double pixels = (double)iterationTarget.width * iterationTarget.height;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, iterationTarget.framebuffer);
+    glViewport(0, 0, iterationTarget.width, iterationTarget.height);
+    Precision wasPrecision = precision;
+
+    std::cout << "Precision tiers (" << precisionNames[wasPrecision]
+              << " in use):";
+    for (int tier = SinglePrecision; tier <= DoublePrecision; tier++) {
+        GLuint shaderProgram = shaderPrograms[tier];
+        if (!shaderProgram) {
+            continue;
+        }
+
+        precision = (Precision)tier;
+        setUniforms(shaderProgram, screenWidth, screenHeight);
+        // The first run also pays for compiling the shader on some drivers.
+        measureFrameTime(shaderProgram, quadVAO, 1);
+        double time = measureFrameTime(shaderProgram, quadVAO, frames);
+        std::cout << " " << precisionNames[tier] << " " << time << " ms ("
+                  << pixels / time / 1e3 << " Mpixel/s)";
+    }
+    std::cout << std::endl;
+
+    precision = wasPrecision;
+    iterationsDirty = true;
+}
+
+// Histogram of the smooth iteration counts and its normalized prefix sum,
+// both computed on the GPU: every escaped pixel is scattered as a point into
+// its bin with additive blending, then each CDF texel sums the bins below it.
+void
+renderHistogram(GLuint histogramProgram,
+                GLuint cdfProgram,
+                GLuint emptyVAO,
+                GLuint quadVAO,
+                const RenderTarget& iterationTarget,
+                const RenderTarget& histogramTarget,
+                const RenderTarget& cdfTarget)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, histogramTarget.framebuffer);
+    glViewport(0, 0, histogramTarget.width, histogramTarget.height);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    glUseProgram(histogramProgram);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, iterationTarget.texture);
+    glUniform1i(glGetUniformLocation(histogramProgram, "iterations"), 0);
+    glUniform1i(glGetUniformLocation(histogramProgram, "jumps"),
+                jumpsForZoom(zoom));
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    glBindVertexArray(emptyVAO);
+    glDrawArrays(GL_POINTS, 0, iterationTarget.width * iterationTarget.height);
+    glDisable(GL_BLEND);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, cdfTarget.framebuffer);
+    glViewport(0, 0, cdfTarget.width, cdfTarget.height);
+
+    glUseProgram(cdfProgram);
+    glBindTexture(GL_TEXTURE_2D, histogramTarget.texture);
+    glUniform1i(glGetUniformLocation(cdfProgram, "histogram"), 0);
+
+    glBindVertexArray(quadVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+}
+
+// The region of the plane that `fragment_shader.frag` maps onto the screen.
+BuddhabrotView
+buddhabrotView(int screenWidth, int screenHeight)
+{
+    BuddhabrotView view;
+    view.left = -0.5 * zoom + 0.5 + offsetX / screenWidth;
+    view.bottom = -0.5 * zoom + 0.5 + offsetY / screenHeight;
+    view.width = zoom;
+    view.height = zoom;
+    view.pixelsX = screenWidth;
+    view.pixelsY = screenHeight;
+    return view;
+}
+
+// Every channel counts the orbits under the zoom's iteration limit, or red,
+// green and blue count orbits under 5000, 500 and 50 iterations.
+std::array<int, 3>
+buddhabrotLimits()
+{
+    if (nebulabrot) {
+        return { 5000, 500, 50 };
+    }
+    int jumps = jumpsForZoom(zoom);
+    return { jumps, jumps, jumps };
+}
+
+void
+uploadDensity(GLuint texture,
+              const BuddhabrotView& view,
+              const std::vector<float>& density)
+{
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexImage2D(GL_TEXTURE_2D,
+                 0,
+                 GL_RGB32F,
+                 view.pixelsX,
+                 view.pixelsY,
+                 0,
+                 GL_RGB,
+                 GL_FLOAT,
+                 density.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+}
+
+void
+renderDensity(GLuint buddhabrotProgram,
+              GLuint quadVAO,
+              GLuint densityTexture,
+              const std::array<float, 3>& scale)
+{
+    glUseProgram(buddhabrotProgram);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, densityTexture);
+    glUniform1i(glGetUniformLocation(buddhabrotProgram, "density"), 0);
+    glUniform3f(glGetUniformLocation(buddhabrotProgram, "scale"),
+                scale[0],
+                scale[1],
+                scale[2]);
+
+    glBindVertexArray(quadVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+}
+
+// Writes 16-bit RGB rows, `pixels` holds them bottom to top.
+bool
+savePNG16(const char* filePath,
+          const std::vector<uint16_t>& pixels,
+          int width,
+          int height)
+{
+    FILE* file = fopen(filePath, "wb");
+    if (!file)
+        return false;
+
+    png_structp image =
+      png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+    png_infop info = image ? png_create_info_struct(image) : nullptr;
+    if (!info || setjmp(png_jmpbuf(image))) {
+        png_destroy_write_struct(&image, &info);
+        fclose(file);
+        return false;
+    }
+
+    png_init_io(image, file);
+    png_set_IHDR(image,
+                 info,
+                 width,
+                 height,
+                 16,
+                 PNG_COLOR_TYPE_RGB,
+                 PNG_INTERLACE_NONE,
+                 PNG_COMPRESSION_TYPE_DEFAULT,
+                 PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(image, info);
+
+    // PNG samples are big-endian.
+    png_set_swap(image);
+    for (int y = height - 1; y >= 0; y--) {
+        png_write_row(
+          image, (png_const_bytep)(pixels.data() + (size_t)y * width * 3));
+    }
+
+    png_write_end(image, nullptr);
+    png_destroy_write_struct(&image, &info);
+    return fclose(file) == 0;
+}
+
+// Saves the density accumulated so far with the preview's tone mapping.
+void
+saveBuddhabrot(Buddhabrot& buddhabrot)
+{
+    std::vector<float> density;
+    copyDensity(buddhabrot, density);
+    std::array<float, 3> scale = densityScale(density);
+
+    std::vector<uint16_t> pixels(density.size());
+    for (size_t i = 0; i < density.size(); i++) {
+        float value = std::sqrt(std::min(density[i] * scale[i % 3], 1.0f));
+        pixels[i] = (uint16_t)std::lround(value * 65535.0f);
+    }
+
+    const char* filePath = "buddhabrot.png";
+    if (savePNG16(filePath,
+                  pixels,
+                  buddhabrot.view.pixelsX,
+                  buddhabrot.view.pixelsY)) {
+        std::cout << "Saved " << filePath << " ("
+                  << buddhabrot.samples.load() << " samples)" << std::endl;
+    } else {
+        std::cerr << "Failed to write " << filePath << std::endl;
+    }
+}
+
+// Binds the textures and sets the uniforms of `coloring.glsl`, the iteration
+// buffer goes to unit 0.
+void
+setColoringUniforms(GLuint shaderProgram,
+                    GLuint paletteTexture,
+                    const RenderTarget& iterationTarget,
+                    const RenderTarget& cdfTarget)
+{
+    glUseProgram(shaderProgram);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, iterationTarget.texture);
+    glUniform1i(glGetUniformLocation(shaderProgram, "iterations"), 0);
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, paletteTexture);
+    glUniform1i(glGetUniformLocation(shaderProgram, "palette"), 1);
+
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, cdfTarget.texture);
+    glUniform1i(glGetUniformLocation(shaderProgram, "cdf"), 2);
+
+    glActiveTexture(GL_TEXTURE0);
+
+    glUniform1i(glGetUniformLocation(shaderProgram, "coloring"), coloring);
+    glUniform1i(glGetUniformLocation(shaderProgram, "jumps"),
+                jumpsForZoom(zoom));
+    const Color& interior = palettes[palette].interior;
+    glUniform3f(glGetUniformLocation(shaderProgram, "interiorColor"),
+                interior[0],
+                interior[1],
+                interior[2]);
+}
+
+// Maps the iteration buffer through the palette into the bound framebuffer.
+void
+renderPalette(GLuint paletteProgram,
+              GLuint quadVAO,
+              GLuint paletteTexture,
+              const RenderTarget& iterationTarget,
+              const RenderTarget& cdfTarget)
+{
+    setColoringUniforms(
+      paletteProgram, paletteTexture, iterationTarget, cdfTarget);
+
+    glBindVertexArray(quadVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+}
+
+// Pixels that get extra samples. A transform feedback pass writes the flagged
+// pixels to `pixels`, the refine pass colors them into consecutive texels of
+// `packed`, and the scatter pass draws those colors back over their pixels.
+struct Refinement
+{
+    GLuint pixels = 0;
+    GLuint pixelsVAO = 0;
+    GLuint query = 0;
+    RenderTarget packed;
+    int count = 0;
+};
+
+Refinement
+createRefinement(int width, int height)
+{
+    Refinement refinement;
+    refinement.packed = createRenderTarget(width, height, GL_RGBA8);
+
+    glGenBuffers(1, &refinement.pixels);
+    glBindBuffer(GL_ARRAY_BUFFER, refinement.pixels);
+    glBufferData(GL_ARRAY_BUFFER,
+                 (GLsizeiptr)width * height * 2 * sizeof(GLint),
+                 nullptr,
+                 GL_DYNAMIC_COPY);
+
+    glGenVertexArrays(1, &refinement.pixelsVAO);
+    glBindVertexArray(refinement.pixelsVAO);
+    glVertexAttribIPointer(0, 2, GL_INT, 2 * sizeof(GLint), (void*)nullptr);
+    glEnableVertexAttribArray(0);
+
+    glGenQueries(1, &refinement.query);
+    return refinement;
+}
+
+void
+deleteRefinement(Refinement& refinement)
+{
+    deleteRenderTarget(refinement.packed);
+    glDeleteBuffers(1, &refinement.pixels);
+    glDeleteVertexArrays(1, &refinement.pixelsVAO);
+    glDeleteQueries(1, &refinement.query);
+    refinement = Refinement{};
+}
+
+// Flags the pixels that differ from their neighbors and compacts them into
+// `refinement.pixels`. Reading back the count waits for the pass, which is
+// short next to the refinement itself.
+void
+compactEdges(GLuint compactProgram,
+             GLuint emptyVAO,
+             Refinement& refinement,
+             GLuint paletteTexture,
+             const RenderTarget& iterationTarget,
+             const RenderTarget& cdfTarget)
+{
+    setColoringUniforms(
+      compactProgram, paletteTexture, iterationTarget, cdfTarget);
+    glUniform1f(glGetUniformLocation(compactProgram, "contrast"),
+                edgeContrast);
+
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, refinement.pixels);
+    glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, refinement.query);
+    glBeginTransformFeedback(GL_POINTS);
+    glBindVertexArray(emptyVAO);
+    glDrawArrays(GL_POINTS, 0, iterationTarget.width * iterationTarget.height);
+    glEndTransformFeedback();
+    glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glDisable(GL_RASTERIZER_DISCARD);
+
+    GLuint count;
+    glGetQueryObjectuiv(refinement.query, GL_QUERY_RESULT, &count);
+    refinement.count = (int)count;
+}
+
+// Supersamples the compacted pixels into `refinement.packed`.
+void
+refinePixels(GLuint refineProgram,
+             const Refinement& refinement,
+             GLuint paletteTexture,
+             const RenderTarget& iterationTarget,
+             const RenderTarget& cdfTarget,
+             int screenWidth,
+             int screenHeight)
+{
+    setUniforms(refineProgram, screenWidth, screenHeight);
+    setColoringUniforms(
+      refineProgram, paletteTexture, iterationTarget, cdfTarget);
+    glUniform1i(glGetUniformLocation(refineProgram, "sampleGrid"), sampleGrid);
+    glUniform1i(glGetUniformLocation(refineProgram, "scatter"), false);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, refinement.packed.framebuffer);
+    glViewport(0, 0, refinement.packed.width, refinement.packed.height);
+    glBindVertexArray(refinement.pixelsVAO);
+    glDrawArrays(GL_POINTS, 0, refinement.count);
+}
+
+// Draws the refined colors over their pixels in the bound framebuffer.
+void
+scatterRefinement(GLuint scatterProgram,
+                  const Refinement& refinement,
+                  int screenWidth,
+                  int screenHeight)
+{
+    glUseProgram(scatterProgram);
+    glUniform2f(glGetUniformLocation(scatterProgram, "screenSize"),
+                (float)screenWidth,
+                (float)screenHeight);
+    glUniform1i(glGetUniformLocation(scatterProgram, "scatter"), true);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, refinement.packed.texture);
+    glUniform1i(glGetUniformLocation(scatterProgram, "refined"), 0);
+
+    glBindVertexArray(refinement.pixelsVAO);
+    glDrawArrays(GL_POINTS, 0, refinement.count);
+}
+
+// Compares the single sample pass with the adaptive refinement of the current
+// view, and with what a uniform supersampling of every pixel would cost.
+void
+benchmarkRefinement(GLuint shaderProgram,
+                    GLuint compactProgram,
+                    GLuint refineProgram,
+                    GLuint quadVAO,
+                    GLuint emptyVAO,
+                    Refinement& refinement,
+                    GLuint paletteTexture,
+                    const RenderTarget& iterationTarget,
+                    const RenderTarget& cdfTarget)
+{
+    int frames = 5;
+    int width = iterationTarget.width;
+    int height = iterationTarget.height;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, iterationTarget.framebuffer);
+    glViewport(0, 0, width, height);
+    setUniforms(shaderProgram, width, height);
+    double singleSample = measureFrameTime(shaderProgram, quadVAO, frames);
+
+    // The first run also pays for compiling the shaders on some drivers.
+    compactEdges(compactProgram,
+                 emptyVAO,
+                 refinement,
+                 paletteTexture,
+                 iterationTarget,
+                 cdfTarget);
+    refinePixels(refineProgram,
+                 refinement,
+                 paletteTexture,
+                 iterationTarget,
+                 cdfTarget,
+                 width,
+                 height);
+
+    GLuint query;
+    glGenQueries(1, &query);
+    double adaptive = 0.0;
+    for (int frame = 0; frame < frames; frame++) {
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        compactEdges(compactProgram,
+                     emptyVAO,
+                     refinement,
+                     paletteTexture,
+                     iterationTarget,
+                     cdfTarget);
+        glEndQuery(GL_TIME_ELAPSED);
+        GLuint64 compaction;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &compaction);
+
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        refinePixels(refineProgram,
+                     refinement,
+                     paletteTexture,
+                     iterationTarget,
+                     cdfTarget,
+                     width,
+                     height);
+        glEndQuery(GL_TIME_ELAPSED);
+        GLuint64 refine;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &refine);
+
+        adaptive += (double)(compaction + refine) / 1e6 / frames;
+    }
+    glDeleteQueries(1, &query);
+    refinementDirty = true;
+
+    int samples = sampleGrid * sampleGrid;
+    std::cout << "Adaptive antialiasing: " << refinement.count << " of "
+              << width * height << " pixels refined with " << samples
+              << " samples, " << singleSample << " ms + " << adaptive
+              << " ms (" << (singleSample + adaptive) / singleSample
+              << "x the single sample cost, uniform supersampling ~"
+              << samples << "x)" << std::endl;
+}
+
+// Cells of the Julia explorer that cover the view. Cell (i, j) holds the
+// parameter ((i + 0.5) * spacingX, (j + 0.5) * spacingY), so a cell keeps its
+// parameter while the view is panned and its thumbnail can be cached.
+struct JuliaGrid
+{
+    double spacingX = 0.0;
+    double spacingY = 0.0;
+    long long firstX = 0;
+    long long firstY = 0;
+    int columns = 0;
+    int rows = 0;
+    double originX = 0.0; // Lower left corner of the first cell in pixels
+    double originY = 0.0;
+    double cellWidth = 0.0;
+    double cellHeight = 0.0;
+};
+
+JuliaGrid
+juliaGrid(int screenWidth, int screenHeight)
+{
+    double cornerX = 0.5 - 0.5 * zoom + offsetX / screenWidth;
+    double cornerY = 0.5 - 0.5 * zoom + offsetY / screenHeight;
+
+    JuliaGrid grid;
+    grid.spacingX = zoom / juliaColumns;
+    grid.spacingY = zoom / juliaRows;
+    grid.firstX = (long long)std::floor(cornerX / grid.spacingX);
+    grid.firstY = (long long)std::floor(cornerY / grid.spacingY);
+    long long lastX = (long long)std::floor((cornerX + zoom) / grid.spacingX);
+    long long lastY = (long long)std::floor((cornerY + zoom) / grid.spacingY);
+    grid.columns = (int)(lastX - grid.firstX + 1);
+    grid.rows = (int)(lastY - grid.firstY + 1);
+    grid.cellWidth = (double)screenWidth / juliaColumns;
+    grid.cellHeight = (double)screenHeight / juliaRows;
+    grid.originX = (grid.firstX * grid.spacingX - cornerX) / zoom * screenWidth;
+    grid.originY =
+      (grid.firstY * grid.spacingY - cornerY) / zoom * screenHeight;
+    return grid;
+}
+
+struct JuliaKey
+{
+    double cX;
+    double cY;
+    int width;
+    int height;
+
+    bool operator<(const JuliaKey& other) const
+    {
+        return std::tie(cX, cY, width, height) <
+               std::tie(other.cX, other.cY, other.width, other.height);
+    }
+};
+
+// Thumbnails of the Julia explorer, cached by parameter and resolution in the
+// slots of an atlas that holds two screens of cells. The thumbnails shown the
+// longest time ago are replaced first.
+struct JuliaThumbnails
+{
+    RenderTarget atlas;
+    int width = 0;
+    int height = 0;
+    int slotColumns = 0;
+    int slotRows = 0;
+    std::map<JuliaKey, int> slots;
+    std::vector<JuliaKey> keys;  // Thumbnail held by every slot
+    std::vector<long> lastShown; // Frame that last showed it, -1 if empty
+    long frame = 0;
+    std::vector<float> cells; // Screen corner and slot of every visible cell
+    GLuint instances = 0;
+    GLuint instancesVAO = 0;
+    int rendered = 0; // Thumbnails rendered by the last update
+};
+
+JuliaThumbnails
+createJuliaThumbnails(int screenWidth, int screenHeight, GLuint quadVBO)
+{
+    JuliaThumbnails thumbnails;
+    thumbnails.width = std::max(1, screenWidth / juliaColumns);
+    thumbnails.height = std::max(1, screenHeight / juliaRows);
+    thumbnails.slotColumns = 2 * (juliaColumns + 1);
+    thumbnails.slotRows = juliaRows + 1;
+    thumbnails.atlas =
+      createRenderTarget(thumbnails.width * thumbnails.slotColumns,
+                         thumbnails.height * thumbnails.slotRows,
+                         GL_R32F);
+
+    int slotCount = thumbnails.slotColumns * thumbnails.slotRows;
+    thumbnails.keys.resize(slotCount);
+    thumbnails.lastShown.assign(slotCount, -1);
+
+    // The quad of every thumbnail is instanced with its parameter or screen
+    // corner, and its slot.
+    glGenBuffers(1, &thumbnails.instances);
+    glGenVertexArrays(1, &thumbnails.instancesVAO);
+    glBindVertexArray(thumbnails.instancesVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+    glVertexAttribPointer(
+      0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)nullptr);
+    glEnableVertexAttribArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, thumbnails.instances);
+    glVertexAttribPointer(
+      1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)nullptr);
+    glVertexAttribPointer(2,
+                          2,
+                          GL_FLOAT,
+                          GL_FALSE,
+                          4 * sizeof(float),
+                          (void*)(2 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
+    glVertexAttribDivisor(1, 1);
+    glVertexAttribDivisor(2, 1);
+
+    return thumbnails;
+}
+
+void
+deleteJuliaThumbnails(JuliaThumbnails& thumbnails)
+{
+    deleteRenderTarget(thumbnails.atlas);
+    glDeleteBuffers(1, &thumbnails.instances);
+    glDeleteVertexArrays(1, &thumbnails.instancesVAO);
+    thumbnails = JuliaThumbnails{};
+}
+
+void
+clearJuliaThumbnails(JuliaThumbnails& thumbnails)
+{
+    thumbnails.slots.clear();
+    std::fill(thumbnails.lastShown.begin(), thumbnails.lastShown.end(), -1);
+}
+
+// Slot for a new thumbnail, never one shown in the current frame since the
+// atlas holds more slots than the grid has cells.
+int
+juliaSlot(const JuliaThumbnails& thumbnails)
+{
+    return (int)(std::min_element(thumbnails.lastShown.begin(),
+                                  thumbnails.lastShown.end()) -
+                 thumbnails.lastShown.begin());
+}
+
+// Looks up the thumbnails of the visible cells and renders the missing ones
+// into their slots, all of them in a single instanced draw.
+void
+updateJuliaThumbnails(GLuint juliaProgram,
+                      JuliaThumbnails& thumbnails,
+                      int screenWidth,
+                      int screenHeight)
+{
+    JuliaGrid grid = juliaGrid(screenWidth, screenHeight);
+    thumbnails.frame++;
+    thumbnails.cells.clear();
+
+    std::vector<float> missing;
+    for (int j = 0; j < grid.rows; j++) {
+        for (int i = 0; i < grid.columns; i++) {
+            JuliaKey key = { (grid.firstX + i + 0.5) * grid.spacingX,
+                             (grid.firstY + j + 0.5) * grid.spacingY,
+                             thumbnails.width,
+                             thumbnails.height };
+
+            int slot;
+            auto cached = thumbnails.slots.find(key);
+            if (cached != thumbnails.slots.end()) {
+                slot = cached->second;
+            } else {
+                slot = juliaSlot(thumbnails);
+                if (thumbnails.lastShown[slot] >= 0) {
+                    thumbnails.slots.erase(thumbnails.keys[slot]);
+                }
+                thumbnails.keys[slot] = key;
+                thumbnails.slots[key] = slot;
+                missing.insert(missing.end(),
+                               { (float)key.cX,
+                                 (float)key.cY,
+                                 (float)(slot % thumbnails.slotColumns),
+                                 (float)(slot / thumbnails.slotColumns) });
+            }
+            thumbnails.lastShown[slot] = thumbnails.frame;
+
+            thumbnails.cells.insert(
+              thumbnails.cells.end(),
+              { (float)(grid.originX + i * grid.cellWidth),
+                (float)(grid.originY + j * grid.cellHeight),
+                (float)(slot % thumbnails.slotColumns),
+                (float)(slot / thumbnails.slotColumns) });
+        }
+    }
+
+    thumbnails.rendered = (int)missing.size() / 4;
+    if (thumbnails.rendered == 0) {
+        return;
+    }
+
+    glUseProgram(juliaProgram);
+    glUniform2f(glGetUniformLocation(juliaProgram, "slotCount"),
+                (float)thumbnails.slotColumns,
+                (float)thumbnails.slotRows);
+    glUniform1f(glGetUniformLocation(juliaProgram, "radius"), juliaRadius);
+    glUniform1i(glGetUniformLocation(juliaProgram, "jumps"),
+                juliaThumbnailJumps);
+
+    glBindBuffer(GL_ARRAY_BUFFER, thumbnails.instances);
+    glBufferData(GL_ARRAY_BUFFER,
+                 missing.size() * sizeof(float),
+                 missing.data(),
+                 GL_STREAM_DRAW);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, thumbnails.atlas.framebuffer);
+    glViewport(0, 0, thumbnails.atlas.width, thumbnails.atlas.height);
+    glBindVertexArray(thumbnails.instancesVAO);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 6, thumbnails.rendered);
+}
+
+// Draws the thumbnails of the visible cells into the bound framebuffer.
+void
+drawJuliaThumbnails(GLuint thumbnailsProgram,
+                    JuliaThumbnails& thumbnails,
+                    GLuint paletteTexture,
+                    const RenderTarget& cdfTarget,
+                    int screenWidth,
+                    int screenHeight)
+{
+    setColoringUniforms(
+      thumbnailsProgram, paletteTexture, thumbnails.atlas, cdfTarget);
+    glUniform1i(glGetUniformLocation(thumbnailsProgram, "jumps"),
+                juliaThumbnailJumps);
+    // The histogram is the one of the main view, fall back to linear colors.
+    if (coloring == 2) {
+        glUniform1i(glGetUniformLocation(thumbnailsProgram, "coloring"), 0);
+    }
+    glUniform2f(glGetUniformLocation(thumbnailsProgram, "screenSize"),
+                (float)screenWidth,
+                (float)screenHeight);
+    glUniform2f(glGetUniformLocation(thumbnailsProgram, "cellSize"),
+                (float)screenWidth / juliaColumns,
+                (float)screenHeight / juliaRows);
+    glUniform2f(glGetUniformLocation(thumbnailsProgram, "thumbnailSize"),
+                (float)thumbnails.width,
+                (float)thumbnails.height);
+
+    glBindBuffer(GL_ARRAY_BUFFER, thumbnails.instances);
+    glBufferData(GL_ARRAY_BUFFER,
+                 thumbnails.cells.size() * sizeof(float),
+                 thumbnails.cells.data(),
+                 GL_STREAM_DRAW);
+
+    glBindVertexArray(thumbnails.instancesVAO);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 6, thumbnails.cells.size() / 4);
+}
+
+// Opens the Julia set of the cell under the window coordinates (`x`, `y`) in
+// the main view, framing the whole set.
+void
+selectJulia(double x, double y, int screenWidth, int screenHeight)
+{
+    JuliaGrid grid = juliaGrid(screenWidth, screenHeight);
+    int i = (int)std::floor((x - grid.originX) / grid.cellWidth);
+    int j =
+      (int)std::floor((screenHeight - y - grid.originY) / grid.cellHeight);
+    juliaC = { (grid.firstX + i + 0.5) * grid.spacingX,
+               (grid.firstY + j + 0.5) * grid.spacingY };
+
+    mandelbrotView = { offsetX, offsetY, zoom };
+    zoom = 2.0 * juliaRadius;
+    offsetX = -0.5 * screenWidth;
+    offsetY = -0.5 * screenHeight;
+
+    julia = true;
+    juliaExplorer = false;
+    iterationsDirty = true;
+    std::cout << "Julia set of c = " << juliaC[0] << " + " << juliaC[1] << "i"
+              << std::endl;
+}
+
+// Times rendering every visible thumbnail at once, as after a zoom. Measured
+// on the wall clock around glFinish, timer queries miss deferred work on some
+// drivers.
+void
+benchmarkJuliaExplorer(GLuint juliaProgram,
+                       JuliaThumbnails& thumbnails,
+                       int screenWidth,
+                       int screenHeight)
+{
+    // The first run also pays for compiling the shader on some drivers.
+    clearJuliaThumbnails(thumbnails);
+    updateJuliaThumbnails(juliaProgram, thumbnails, screenWidth, screenHeight);
+    glFinish();
+
+    clearJuliaThumbnails(thumbnails);
+    double start = glfwGetTime();
+    updateJuliaThumbnails(juliaProgram, thumbnails, screenWidth, screenHeight);
+    glFinish();
+    double milliseconds = (glfwGetTime() - start) * 1e3;
+
+    std::cout << "Julia explorer: " << thumbnails.rendered << " thumbnails of "
+              << thumbnails.width << "x" << thumbnails.height
+              << " in one draw, " << milliseconds << " ms" << std::endl;
 }
 
 int
@@ -123,10 +1358,44 @@ main()
     // Load and compile shaders
 
     std::string vertexShaderSource = readFile("vertex_shader.vert");
-    std::string fragmentShaderSource = readFile("fragment_shader.frag");
+    std::string refineVertexSource = readFile("vertex_shader_refine.vert");
 
-    GLuint shaderProgram =
-      createShaderProgram(vertexShaderSource, fragmentShaderSource);
+    // The iterating shaders are built once per precision tier.
+    bool doubleSupported = GLEW_ARB_gpu_shader_fp64;
+    std::array<GLuint, 3> shaderPrograms = {};
+    std::array<GLuint, 3> refinePrograms = {};
+    for (int tier = SinglePrecision; tier <= DoublePrecision; tier++) {
+        if (tier == DoublePrecision && !doubleSupported) {
+            continue;
+        }
+        shaderPrograms[tier] = createShaderProgram(
+          vertexShaderSource,
+          readViewShader("fragment_shader.frag", (Precision)tier));
+        refinePrograms[tier] = createShaderProgram(
+          refineVertexSource,
+          readViewShader("fragment_shader_refine.frag", (Precision)tier));
+    }
+
+    GLuint paletteProgram = createShaderProgram(
+      vertexShaderSource, readShader("fragment_shader_palette.frag"));
+    GLuint histogramProgram =
+      createShaderProgram(readFile("vertex_shader_histogram.vert"),
+                          readFile("fragment_shader_histogram.frag"));
+    GLuint cdfProgram = createShaderProgram(
+      vertexShaderSource, readFile("fragment_shader_cdf.frag"));
+    GLuint buddhabrotProgram = createShaderProgram(
+      vertexShaderSource, readFile("fragment_shader_buddhabrot.frag"));
+    GLuint compactProgram =
+      createCompactionProgram(readShader("vertex_shader_compact.vert"),
+                              readFile("geometry_shader_compact.geom"));
+    GLuint scatterProgram = createShaderProgram(
+      refineVertexSource, readFile("fragment_shader_scatter.frag"));
+    GLuint juliaProgram =
+      createShaderProgram(readFile("vertex_shader_julia.vert"),
+                          readShader("fragment_shader_julia.frag"));
+    GLuint thumbnailsProgram =
+      createShaderProgram(readFile("vertex_shader_thumbnails.vert"),
+                          readShader("fragment_shader_thumbnails.frag"));
 
     GLuint quadVBO;
     glGenBuffers(1, &quadVBO);
@@ -142,42 +1411,208 @@ main()
       0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)nullptr);
     glEnableVertexAttribArray(0);
 
-    glUseProgram(shaderProgram);
-    glBindVertexArray(quadVAO);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
+    // Attribute-less draws (the histogram scatter) still need a bound VAO.
+    GLuint emptyVAO;
+    glGenVertexArrays(1, &emptyVAO);
+
+    std::vector<GLuint> paletteTextures;
+    for (const Palette& palette : palettes) {
+        paletteTextures.push_back(createPaletteTexture(palette));
+    }
+
+    RenderTarget iterationTarget;
+    RenderTarget histogramTarget =
+      createRenderTarget(histogramBins, 1, GL_R32F);
+    RenderTarget cdfTarget = createRenderTarget(histogramBins, 1, GL_R32F);
+    Refinement refinement;
+    JuliaThumbnails juliaThumbnails;
+
+    // Leave a core to the rendering thread.
+    int buddhabrotThreads =
+      std::max(1, (int)std::thread::hardware_concurrency() - 1);
+    Buddhabrot buddhabrot;
+    std::vector<float> density;
+    std::array<float, 3> densityScales = { 1.0f, 1.0f, 1.0f };
+    GLuint densityTexture;
+    glGenTextures(1, &densityTexture);
+    double lastPreview = 0.0;
 
     glfwSetScrollCallback(window, scrollCallback);
     glfwSetCursorPosCallback(window, cursorPositionCallback);
+    glfwSetKeyCallback(window, keyCallback);
+    glfwSetMouseButtonCallback(window, mouseButtonCallback);
 
     // Rendering loop
 
     while (!glfwWindowShouldClose(window)) {
-        // Clear the screen
-
-        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
-
         int screenWidth, screenHeight;
         glfwGetFramebufferSize(window, &screenWidth, &screenHeight);
-        GLint screenSizeLocation =
-          glGetUniformLocation(shaderProgram, "screenSize");
-        glUseProgram(shaderProgram);
-        glUniform2f(
-          screenSizeLocation, (float)screenWidth, (float)screenHeight);
 
-        GLint offsetLocation = glGetUniformLocation(shaderProgram, "offset");
-        glUseProgram(shaderProgram);
-        glUniform2f(offsetLocation, (float)offsetX, (float)offsetY);
+        if (iterationTarget.width != screenWidth ||
+            iterationTarget.height != screenHeight) {
+            deleteRenderTarget(iterationTarget);
+            iterationTarget =
+              createRenderTarget(screenWidth, screenHeight, GL_R32F);
+            deleteRefinement(refinement);
+            refinement = createRefinement(screenWidth, screenHeight);
+            deleteJuliaThumbnails(juliaThumbnails);
+            juliaThumbnails =
+              createJuliaThumbnails(screenWidth, screenHeight, quadVBO);
+            iterationsDirty = true;
+        }
 
-        GLint zoomLocation = glGetUniformLocation(shaderProgram, "zoom");
-        glUseProgram(shaderProgram);
-        glUniform1f(zoomLocation, (float)zoom);
+        if (juliaSelectRequested) {
+            selectJulia(
+              juliaSelectX, juliaSelectY, screenWidth, screenHeight);
+            juliaSelectRequested = false;
+        }
 
-        // Render the screen
+        // Switch to the precision tier that resolves the current pixels
 
-        glUseProgram(shaderProgram);
-        glBindVertexArray(quadVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+        Precision viewPrecision =
+          precisionForZoom(zoom, screenWidth, doubleSupported);
+        if (viewPrecision != precision) {
+            precision = viewPrecision;
+            std::cout << "Precision: " << precisionNames[precision]
+                      << std::endl;
+        }
+        GLuint shaderProgram = shaderPrograms[precision];
+        GLuint refineProgram = refinePrograms[precision];
+
+        if (benchmarkRequested && juliaExplorer) {
+            benchmarkJuliaExplorer(
+              juliaProgram, juliaThumbnails, screenWidth, screenHeight);
+            benchmarkRequested = false;
+        } else if (benchmarkRequested) {
+            benchmark(shaderProgram,
+                      quadVAO,
+                      iterationTarget,
+                      screenWidth,
+                      screenHeight);
+            benchmarkPrecision(shaderPrograms,
+                               quadVAO,
+                               iterationTarget,
+                               screenWidth,
+                               screenHeight);
+            benchmarkRefinement(shaderProgram,
+                                compactProgram,
+                                refineProgram,
+                                quadVAO,
+                                emptyVAO,
+                                refinement,
+                                paletteTextures[palette],
+                                iterationTarget,
+                                cdfTarget);
+            benchmarkRequested = false;
+        }
+
+        // Restart the orbit sampling when the view changed, and refresh the
+        // preview from the running sampler every so often
+
+        if (buddhabrotMode) {
+            BuddhabrotView view = buddhabrotView(screenWidth, screenHeight);
+            std::array<int, 3> limits = buddhabrotLimits();
+            if (!buddhabrot.running || !(buddhabrot.view == view) ||
+                buddhabrot.limits != limits) {
+                startBuddhabrot(buddhabrot, view, limits, buddhabrotThreads);
+                lastPreview = -buddhabrotPreviewInterval;
+            }
+
+            double now = glfwGetTime();
+            if (now - lastPreview >= buddhabrotPreviewInterval) {
+                copyDensity(buddhabrot, density);
+                densityScales = densityScale(density);
+                uploadDensity(densityTexture, buddhabrot.view, density);
+                lastPreview = now;
+            }
+
+            if (buddhabrotSaveRequested) {
+                saveBuddhabrot(buddhabrot);
+            }
+        } else if (buddhabrot.running) {
+            stopBuddhabrot(buddhabrot);
+        }
+        buddhabrotSaveRequested = false;
+
+        // Render the thumbnails that are not cached yet
+
+        if (juliaExplorer) {
+            updateJuliaThumbnails(
+              juliaProgram, juliaThumbnails, screenWidth, screenHeight);
+        }
+
+        // Iterate the fractal only when the view changed
+
+        bool mainView = !buddhabrotMode && !juliaExplorer;
+        if (iterationsDirty && mainView) {
+            setUniforms(shaderProgram, screenWidth, screenHeight);
+
+            glBindFramebuffer(GL_FRAMEBUFFER, iterationTarget.framebuffer);
+            glViewport(0, 0, screenWidth, screenHeight);
+            glUseProgram(shaderProgram);
+            glBindVertexArray(quadVAO);
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+
+            renderHistogram(histogramProgram,
+                            cdfProgram,
+                            emptyVAO,
+                            quadVAO,
+                            iterationTarget,
+                            histogramTarget,
+                            cdfTarget);
+
+            iterationsDirty = false;
+            refinementDirty = true;
+        }
+
+        // Supersample the pixels that differ from their neighbors, again only
+        // when the view or the colors changed
+
+        if (antialiasing && refinementDirty && mainView) {
+            compactEdges(compactProgram,
+                         emptyVAO,
+                         refinement,
+                         paletteTextures[palette],
+                         iterationTarget,
+                         cdfTarget);
+            refinePixels(refineProgram,
+                         refinement,
+                         paletteTextures[palette],
+                         iterationTarget,
+                         cdfTarget,
+                         screenWidth,
+                         screenHeight);
+            refinementDirty = false;
+        }
+
+        // Color the screen
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, screenWidth, screenHeight);
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        if (juliaExplorer) {
+            drawJuliaThumbnails(thumbnailsProgram,
+                                juliaThumbnails,
+                                paletteTextures[palette],
+                                cdfTarget,
+                                screenWidth,
+                                screenHeight);
+        } else if (buddhabrotMode) {
+            renderDensity(
+              buddhabrotProgram, quadVAO, densityTexture, densityScales);
+        } else {
+            renderPalette(paletteProgram,
+                          quadVAO,
+                          paletteTextures[palette],
+                          iterationTarget,
+                          cdfTarget);
+            if (antialiasing) {
+                scatterRefinement(
+                  scatterProgram, refinement, screenWidth, screenHeight);
+            }
+        }
 
         // Swap buffers and poll events
 
@@ -187,7 +1622,27 @@ main()
 
     // Cleanup
 
-    glDeleteProgram(shaderProgram);
+    stopBuddhabrot(buddhabrot);
+    glDeleteTextures(1, &densityTexture);
+    deleteRenderTarget(iterationTarget);
+    deleteRenderTarget(histogramTarget);
+    deleteRenderTarget(cdfTarget);
+    deleteRefinement(refinement);
+    deleteJuliaThumbnails(juliaThumbnails);
+    glDeleteTextures(paletteTextures.size(), paletteTextures.data());
+
+    for (int tier = SinglePrecision; tier <= DoublePrecision; tier++) {
+        glDeleteProgram(shaderPrograms[tier]);
+        glDeleteProgram(refinePrograms[tier]);
+    }
+    glDeleteProgram(paletteProgram);
+    glDeleteProgram(histogramProgram);
+    glDeleteProgram(cdfProgram);
+    glDeleteProgram(buddhabrotProgram);
+    glDeleteProgram(compactProgram);
+    glDeleteProgram(scatterProgram);
+    glDeleteProgram(juliaProgram);
+    glDeleteProgram(thumbnailsProgram);
     glfwTerminate();
 
     return 0;
@@ -0,0 +1,37 @@
+#version 330 core
+
+#include "coloring.glsl"
+
+uniform sampler2D iterations;
+uniform int jumps;
+uniform float contrast;
+
+flat out ivec2 vertexPixel;
+flat out int vertexEdge;
+
+// One point per pixel of the iteration buffer. A pixel is flagged for extra
+// samples when its color differs from one of its eight neighbors by more than
+// `contrast` in some channel, which catches both the boundary of the set and
+// steep iteration gradients.
+void
+main()
+{
+    ivec2 size = textureSize(iterations, 0);
+    ivec2 pixel = ivec2(gl_VertexID % size.x, gl_VertexID / size.x);
+    vec3 color = colorIterations(texelFetch(iterations, pixel, 0).r, jumps);
+
+    vec3 difference = vec3(0.0);
+    for (int y = -1; y <= 1; y++) {
+        for (int x = -1; x <= 1; x++) {
+            ivec2 neighbor = clamp(pixel + ivec2(x, y), ivec2(0), size - 1);
+            float n = texelFetch(iterations, neighbor, 0).r;
+            difference =
+              max(difference, abs(colorIterations(n, jumps) - color));
+        }
+    }
+
+    vertexPixel = pixel;
+    vertexEdge = int(max(max(difference.r, difference.g), difference.b) >
+                     contrast);
+    gl_Position = vec4(0.0, 0.0, 0.0, 1.0);
+}
@@ -0,0 +1,21 @@
+#version 330 core
+
+#define HISTOGRAM_BINS 1024
+
+uniform sampler2D iterations;
+uniform int jumps;
+
+// One point is drawn per pixel of the iteration buffer and lands in the texel
+// of its histogram bin; points of pixels inside the set are clipped away.
+void
+main()
+{
+    ivec2 size = textureSize(iterations, 0);
+    ivec2 pixel = ivec2(gl_VertexID % size.x, gl_VertexID / size.x);
+    float n = texelFetch(iterations, pixel, 0).r;
+
+    float bin = floor(n / float(jumps + 2) * float(HISTOGRAM_BINS));
+    float x = (bin + 0.5) / float(HISTOGRAM_BINS) * 2.0 - 1.0;
+
+    gl_Position = n < 0.0 ? vec4(2.0, 2.0, 0.0, 1.0) : vec4(x, 0.0, 0.0, 1.0);
+}
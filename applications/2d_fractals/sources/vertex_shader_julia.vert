@@ -0,0 +1,23 @@
+#version 330 core
+
+// One instance per thumbnail of the Julia explorer: the quad covers the slot
+// of the atlas that caches the thumbnail, and the Julia set of `c` is spread
+// over it.
+layout(location = 0) in vec2 position;
+layout(location = 1) in vec2 c;
+layout(location = 2) in vec2 slot;
+
+uniform vec2 slotCount; // Columns and rows of slots in the atlas
+uniform float radius;   // Half size of the region of the plane shown
+
+out vec2 point;
+flat out vec2 juliaC;
+
+void
+main()
+{
+    vec2 corner = position * 0.5 + 0.5;
+    gl_Position = vec4((slot + corner) / slotCount * 2.0 - 1.0, 0.0, 1.0);
+    point = position * radius;
+    juliaC = c;
+}
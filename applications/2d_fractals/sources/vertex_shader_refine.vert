@@ -0,0 +1,24 @@
+#version 330 core
+
+layout(location = 0) in ivec2 pixel;
+
+uniform vec2 screenSize;
+uniform bool scatter;
+
+flat out ivec2 refinedPixel;
+flat out ivec2 packedTexel;
+
+// Draws the compacted pixel list as points. The refine pass packs point `i`
+// into texel `i` of a row-major target, so that no fragment is wasted on
+// pixels without extra samples. The scatter pass puts every point back on
+// its pixel.
+void
+main()
+{
+    int width = int(screenSize.x);
+    packedTexel = ivec2(gl_VertexID % width, gl_VertexID / width);
+    refinedPixel = pixel;
+
+    vec2 target = scatter ? vec2(pixel) : vec2(packedTexel);
+    gl_Position = vec4((target + 0.5) / screenSize * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,23 @@
+#version 330 core
+
+// One instance per visible cell of the Julia explorer: the quad covers the
+// cell on the screen, less a gap, and reads the thumbnail from its slot.
+layout(location = 0) in vec2 position;
+layout(location = 1) in vec2 cell; // Lower left corner in pixels
+layout(location = 2) in vec2 slot;
+
+uniform vec2 screenSize;
+uniform vec2 cellSize;      // In pixels, gap included
+uniform vec2 thumbnailSize; // In texels
+
+out vec2 texel;
+
+void
+main()
+{
+    const float gap = 1.0;
+    vec2 corner = position * 0.5 + 0.5;
+    vec2 pixel = cell + corner * (cellSize - gap);
+    gl_Position = vec4(pixel / screenSize * 2.0 - 1.0, 0.0, 1.0);
+    texel = (slot + corner) * thumbnailSize;
+}
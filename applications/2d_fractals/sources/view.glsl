@@ -0,0 +1,85 @@
+// Maps pixels to points of the plane and iterates them in the precision tier
+// picked by the host, which defines `PRECISION_DOUBLE` or
+// `PRECISION_DOUBLE_FLOAT` after the version line (single precision
+// otherwise). Include it before anything else, it may enable extensions.
+
+#if defined(PRECISION_DOUBLE)
+#extension GL_ARB_gpu_shader_fp64 : require
+#elif defined(PRECISION_DOUBLE_FLOAT) && defined(GL_ARB_gpu_shader5)
+#extension GL_ARB_gpu_shader5 : enable
+#endif
+
+#include "escape_time.glsl"
+
+#if defined(PRECISION_DOUBLE)
+#include "escape_time_double.glsl"
+#elif defined(PRECISION_DOUBLE_FLOAT)
+#include "escape_time_double_float.glsl"
+#endif
+
+uniform int jumps;
+uniform bool optimized;
+
+// Point at the corner of pixel (0, 0) and size of a pixel, so that the point
+// at pixel coordinates `p` is `viewCorner + p * viewStep`. Double-float values
+// hold (x.high, x.low, y.high, y.low).
+#if defined(PRECISION_DOUBLE)
+uniform dvec2 viewCorner;
+uniform dvec2 viewStep;
+#elif defined(PRECISION_DOUBLE_FLOAT)
+uniform vec4 viewCorner;
+uniform vec4 viewStep;
+#else
+uniform vec2 viewCorner;
+uniform vec2 viewStep;
+#endif
+
+// The view shows the Julia set of `juliaC` instead of the Mandelbrot set.
+// Interior and cycle tests only apply to the Mandelbrot set.
+uniform bool julia;
+#if defined(PRECISION_DOUBLE)
+uniform dvec2 juliaC;
+#elif defined(PRECISION_DOUBLE_FLOAT)
+uniform vec4 juliaC;
+#else
+uniform vec2 juliaC;
+#endif
+
+float
+pixelSize()
+{
+    return float(viewStep.x);
+}
+
+// Escape time of the point at pixel coordinates `position`, cycles are
+// detected when the orbit closes within `tolerance`.
+float
+escapeTimeAt(vec2 position, float tolerance)
+{
+#if defined(PRECISION_DOUBLE)
+    dvec2 c = viewCorner + dvec2(position) * viewStep;
+    if (julia) {
+        return escapeTimeJulia(c, juliaC, jumps);
+    }
+    return optimized ? escapeTimeOptimized(c, double(tolerance), jumps)
+                     : escapeTime(c, jumps);
+#elif defined(PRECISION_DOUBLE_FLOAT)
+    vec4 c = vec4(
+      addDoubleFloat(viewCorner.xy,
+                     multiplyDoubleFloat(vec2(position.x, 0.0), viewStep.xy)),
+      addDoubleFloat(viewCorner.zw,
+                     multiplyDoubleFloat(vec2(position.y, 0.0), viewStep.zw)));
+    if (julia) {
+        return escapeTimeDoubleFloatJulia(c, juliaC, jumps);
+    }
+    return optimized ? escapeTimeDoubleFloatOptimized(c, tolerance, jumps)
+                     : escapeTimeDoubleFloat(c, jumps);
+#else
+    vec2 c = viewCorner + position * viewStep;
+    if (julia) {
+        return escapeTimeJulia(c, juliaC, jumps);
+    }
+    return optimized ? escapeTimeOptimized(c, tolerance, jumps)
+                     : escapeTime(c, jumps);
+#endif
+}
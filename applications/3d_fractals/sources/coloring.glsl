@@ -0,0 +1,106 @@
+// Coloring modes of the G-buffer, shared by the shaders that color pixels.
+// Included with `#include "coloring.glsl"` after the version line.
+
+uniform sampler2D palette;
+uniform int coloring;
+
+// Constants
+#define PI 3.1415925359
+#define MARCHING_MAX_STEPS 100
+#define MARCHING_MAX_DISTANCE 10.
+
+#define COLORING_LIGHTING 0
+#define COLORING_ORBIT_TRAP 1
+#define COLORING_PALETTE 2
+#define COLORING_DEPTH 3
+#define COLORING_OCCLUSION 4
+#define COLORING_NORMAL 5
+
+float
+map(float value,
+    float inputMin,
+    float inputMax,
+    float outputMin,
+    float outputMax)
+{
+    // Calculate the normalized position of the value within the input range
+    float normalizedValue = (value - inputMin) / (inputMax - inputMin);
+
+    // Map the normalized value to the output range
+    return outputMin + (outputMax - outputMin) * normalizedValue;
+}
+
+vec3
+hue_shift(vec3 color, float dhue)
+{
+    float s = sin(dhue);
+    float c = cos(dhue);
+    return (color * c) +
+           (color * s) * mat3(vec3(0.167444, 0.329213, -0.496657),
+                              vec3(-0.327948, 0.035669, 0.292279),
+                              vec3(1.250268, -1.047561, -0.202707)) +
+           dot(vec3(0.299, 0.587, 0.114), color) * (1.0 - c);
+}
+
+// Color of a pixel from its G-buffer values, see the outputs of
+// `fragment_shader.frag`.
+vec3
+colorSurface(vec4 surfaceSample, vec4 trapsSample, vec4 marchingSample)
+{
+    vec3 lighting = surfaceSample.rgb;
+    float distance = surfaceSample.a;
+    vec3 orbitTrap = trapsSample.rgb;
+    float minimumDistanceForGlow = trapsSample.a;
+    vec3 normal = marchingSample.xyz;
+    float steps = marchingSample.w;
+
+    bool escaped = dot(normal, normal) == 0.;
+    float occlusion = 1. - steps / float(MARCHING_MAX_STEPS);
+
+    vec3 color = vec3(0);
+
+    if (coloring == COLORING_LIGHTING) {
+
+        color = lighting;
+
+    } else if (coloring == COLORING_ORBIT_TRAP) {
+
+        if (escaped) {
+            minimumDistanceForGlow =
+              min(max(minimumDistanceForGlow * 4, 0.), 1.);
+            minimumDistanceForGlow = 1 - minimumDistanceForGlow;
+            minimumDistanceForGlow *= 0.5;
+            color = vec3(minimumDistanceForGlow, 0., 0.);
+            color = hue_shift(color, PI / 4);
+        } else {
+            orbitTrap.x = map(orbitTrap.x, 0, MARCHING_MAX_DISTANCE, 0, 1);
+            orbitTrap.z = map(orbitTrap.z, 0, MARCHING_MAX_DISTANCE, 0, 1);
+
+            color = vec3(orbitTrap.x, 0, orbitTrap.z);
+            color = hue_shift(color, PI / 12);
+            color *= occlusion;
+        }
+
+    } else if (coloring == COLORING_PALETTE) {
+
+        if (!escaped) {
+            float t = fract(sqrt(orbitTrap.x));
+            float shade = dot(vec3(0.299, 0.587, 0.114), lighting);
+            color = texture(palette, vec2(t, 0.5)).rgb * (0.25 + 0.75 * shade);
+        }
+
+    } else if (coloring == COLORING_DEPTH) {
+
+        color = vec3(1 - map(distance, 0, MARCHING_MAX_DISTANCE, 0, 1));
+
+    } else if (coloring == COLORING_OCCLUSION) {
+
+        color = vec3(occlusion);
+
+    } else if (coloring == COLORING_NORMAL) {
+
+        color = escaped ? vec3(0) : normal * 0.5 + 0.5;
+    }
+
+    return color;
+}
@@ -0,0 +1,377 @@
+// Distance estimators shared by every shader that evaluates the fractals.
+// Included with `#include "distance_estimators.glsl"` after the version line.
+
+uniform float time; // Time elapsed
+uniform int fractal;
+
+#define FRACTAL_MANDELBULB 0
+#define FRACTAL_MENGER_SPONGE 1
+#define FRACTAL_JULIA 2
+#define FRACTAL_APOLLONIAN 3
+#define FRACTAL_MANDELBOX 4
+
+vec3 orbitTrap = vec3(1e9);
+
+// Size of the smallest detail a pixel shows around the evaluated point, set
+// by the marchers from the pixel footprint. Zero keeps every iteration.
+float detailSize = 0.;
+
+// Iterations after which the features of a fractal, `size` large at first and
+// shrinking by `shrink` at every iteration, fall below `detailSize`, plus one
+// so that normals stay smooth. The level is fractional: the estimators blend
+// the distances after the two nearest counts, so surfaces do not pop as the
+// camera moves.
+float
+iterationLevel(float size, float shrink, int iterations)
+{
+    if (detailSize <= 0.) {
+        return float(iterations);
+    }
+    float level = log(size / detailSize) / log(shrink) + 1.;
+    return clamp(level, 1., float(iterations));
+}
+
+float
+DEMandelbulb(vec3 pos)
+{
+
+    vec3 z = pos;
+    float dr = 1.0;
+    float r = 0.0;
+
+    float amplitude = 3.;
+    float power = 3. + sin(time / amplitude) * amplitude + amplitude;
+
+    float bailout = 4;
+    float level = iterationLevel(1., power, 5);
+    int iterations = int(ceil(level));
+    int coarseIterations = int(level);
+    float coarse = 0.;
+    bool blended = false;
+
+    for (int i = 0; i < iterations; i++) {
+
+        if (i == coarseIterations) {
+            coarse = 0.5 * log(r) * r / dr;
+            blended = true;
+        }
+
+        r = length(z);
+
+        if (r > bailout)
+            break;
+
+        // Convert to polar coordinates.
+        // float theta = acos(z.z / r);
+        // float phi = atan(z.y, z.x);
+        float theta = asin(z.z / r);
+        float phi = atan(z.y, z.x);
+        dr = pow(r, power - 1.0) * power * dr + 1.0;
+
+        // Scale and rotate the point.
+        float zr = pow(r, power);
+        theta = theta * power;
+        phi = phi * power;
+
+        // Convert back to cartesian coordinates.
+        // z = zr * vec3(sin(theta) * cos(phi), sin(phi) * sin(theta),
+        // cos(theta));
+        z = zr * vec3(cos(theta) * cos(phi), cos(theta) * sin(phi), sin(theta));
+        z += pos;
+
+        orbitTrap.x = min(orbitTrap.x, pow(length(z - vec3(1, 0, 0)), 2.));
+        orbitTrap.y = min(orbitTrap.y, pow(length(z - vec3(0, 1, 0)), 2.));
+        orbitTrap.z = min(orbitTrap.z, pow(length(z - vec3(0, 0, 2)), 2.));
+    }
+
+    float distance = 0.5 * log(r) * r / dr;
+    return blended ? mix(coarse, distance, level - float(coarseIterations))
+                   : distance;
+}
+
+// Computes the distance estimate (DE) for the Menger Sponge fractal using the
+// distance field algorithm
+float
+DEMengerSponge(vec3 pos)
+{
+    // Center the position and scale it
+    float x = pos.x * 0.5 + 0.5;
+    float y = pos.y * 0.5 + 0.5;
+    float z = pos.z * 0.5 + 0.5;
+
+    // Compute the distance to the initial box
+    float xx = abs(x - 0.5) - 0.5;
+    float yy = abs(y - 0.5) - 0.5;
+    float zz = abs(z - 0.5) - 0.5;
+    float d1 = max(xx, max(yy, zz));
+
+    // Initialize the current computed distance
+    float d = d1;
+
+    // Initialize the scaling factor
+    float p = 1.0;
+
+    // Set the number of iterations, the distances after the last two are
+    // blended
+    float level = iterationLevel(2., 3., 10);
+    int n = int(ceil(level));
+    int coarseIterations = int(level);
+    float coarse = d;
+
+    // Perform iterations to compute the DE
+    for (int i = 1; i <= n; ++i) {
+        // Compute the translated/rotated positions
+        float xa = mod(3.0 * x * p, 3.0);
+        float ya = mod(3.0 * y * p, 3.0);
+        float za = mod(3.0 * z * p, 3.0);
+        p *= 3.0;
+
+        // Compute the distance inside the 3 axis-aligned square tubes
+        float xx = 0.5 - abs(xa - 1.5);
+        float yy = 0.5 - abs(ya - 1.5);
+        float zz = 0.5 - abs(za - 1.5);
+        d1 = min(max(xx, zz), min(max(xx, yy), max(yy, zz))) / p;
+
+        // Take the intersection of the current computed distance and the
+        // previous distance
+        d = max(d, d1);
+        if (i == coarseIterations) {
+            coarse = d;
+        }
+
+        orbitTrap.x = min(orbitTrap.x, pow(length(d - vec3(1, 0, 0)), 2.));
+        orbitTrap.y = min(orbitTrap.y, pow(length(d - vec3(0, 1, 0)), 2.));
+        orbitTrap.z = min(orbitTrap.z, pow(length(d - vec3(0, 0, 1)), 2.));
+    }
+
+    // Return the final distance estimate
+    return mix(coarse, d, level - float(coarseIterations));
+}
+
+mat3
+rotate(vec3 axis, float angle)
+{
+    float c = cos(angle);
+    float s = sin(angle);
+    float oneMinusC = 1.0 - c;
+
+    float x = axis.x;
+    float y = axis.y;
+    float z = axis.z;
+
+    return mat3(x * x * oneMinusC + c,
+                x * y * oneMinusC - z * s,
+                x * z * oneMinusC + y * s,
+                y * x * oneMinusC + z * s,
+                y * y * oneMinusC + c,
+                y * z * oneMinusC - x * s,
+                z * x * oneMinusC - y * s,
+                z * y * oneMinusC + x * s,
+                z * z * oneMinusC + c);
+}
+
+float
+quaternionLength(vec4 q)
+{
+    return sqrt(dot(q, q));
+}
+
+vec4
+quaternionMultiplication(vec4 a, vec4 b)
+{
+    return vec4(a.x * b.x - a.y * b.y - a.z * b.z - a.w * b.w,
+                a.x * b.y + a.y * b.x + a.z * b.w - a.w * b.z,
+                a.x * b.z - a.y * b.w + a.z * b.x + a.w * b.y,
+                a.x * b.w + a.y * b.z - a.z * b.y + a.w * b.x);
+}
+
+vec4
+quaternionSquare(vec4 q)
+{
+    return quaternionMultiplication(q, q);
+}
+
+float
+DEPlane(vec3 p, vec3 planeNormal, vec3 planePoint)
+{
+    return dot(p - planePoint, planeNormal);
+}
+
+vec4
+quaternionPower(vec4 q, float p)
+{
+    // If the quaternion is close to zero, return it
+    if (length(q) < 0.0001)
+        return q;
+    float a = acos(q.w);
+    float newA = a * p;
+    vec3 normAxis = normalize(q.xyz);
+    vec4 result;
+    result.w = cos(newA);
+    result.xyz = normAxis * sin(newA);
+    return result;
+}
+
+float
+DEJulia(vec3 pos)
+{
+    const int MAX_ITER = 32;
+    const float BAIL_OUT = 2.0;
+
+    // Near the surface the estimate changes by about 1.5x less with every
+    // further iteration.
+    float level = iterationLevel(1., 1.5, MAX_ITER);
+    int iterations = int(ceil(level));
+    int coarseIterations = int(level);
+    float coarse = 0.;
+    bool blended = false;
+
+    vec4 c = vec4(-0.8 + 0.2 * sin(time * 4), 0.156, 0.0, 0.0);
+
+    vec4 z = vec4(pos, 0.0);
+    vec4 dz = vec4(1.0, 0.0, 0.0, 0.0);
+
+    for (int i = 0; i < iterations; ++i) {
+
+        if (i == coarseIterations) {
+            coarse = 0.5 * quaternionLength(z) * log(quaternionLength(z)) /
+                     quaternionLength(dz);
+            blended = true;
+        }
+
+        float d = quaternionLength(z);
+
+        if (d > BAIL_OUT)
+            break;
+
+        dz = 2.0 * quaternionMultiplication(z, dz);
+
+        z = quaternionSquare(z) + c;
+
+        orbitTrap.x =
+          min(orbitTrap.x, pow(length(vec3(z) - vec3(2, 0, 0)), 2.));
+        orbitTrap.y =
+          min(orbitTrap.y, pow(length(vec3(z) - vec3(0, 1, 0)), 2.));
+        orbitTrap.z =
+          min(orbitTrap.z, pow(length(vec3(z) - vec3(0, 0, 2)), 2.));
+    }
+
+    float distance = 0.5 * quaternionLength(z) * log(quaternionLength(z)) /
+                     quaternionLength(dz);
+
+    return blended ? mix(coarse, distance, level - float(coarseIterations))
+                   : distance;
+}
+
+const float BAIL_OUT = 2.0;
+
+vec3
+wrapVector3(vec3 value, float min, float max)
+{
+    vec3 range = vec3(max - min);
+    return vec3(min) + mod(mod(value - vec3(min), range) + range, range);
+}
+
+float
+DEApollonian(vec3 pos)
+{
+    // The inversions shrink the spheres by about 4x per iteration.
+    float level = iterationLevel(2., 4., 8);
+    int iterations = int(ceil(level));
+    int coarseIterations = int(level);
+    float scale = 1;
+    float coarse = 0.;
+
+    for (int i = 0; i < iterations; i++) {
+
+        if (i == coarseIterations) {
+            coarse = abs(pos.z) * 0.25 / scale;
+        }
+
+        pos = wrapVector3(pos, -1, 1);
+
+        float d = dot(pos, pos);
+        float r = 1.333;
+        float a = r / d;
+
+        scale = a * scale;
+        pos = pos * a;
+    }
+
+    float distance = abs(pos.z) * 0.25 / scale;
+    return iterations > coarseIterations
+             ? mix(coarse, distance, level - float(coarseIterations))
+             : distance;
+}
+
+float fixedRadius2 = 1.0;
+float minRadius2 = 0.5;
+float foldingLimit = 1;
+
+void
+sphereFold(inout vec3 z, inout float dz)
+{
+    float r2 = dot(z, z);
+    if (r2 < minRadius2) {
+        // linear inner scaling
+        float temp = (fixedRadius2 / minRadius2);
+        z *= temp;
+        dz *= temp;
+    } else if (r2 < fixedRadius2) {
+        // this is the actual sphere inversion
+        float temp = (fixedRadius2 / r2);
+        z *= temp;
+        dz *= temp;
+    }
+}
+
+void
+boxFold(inout vec3 z, inout float dz)
+{
+    z = clamp(z, -foldingLimit, foldingLimit) * 2.0 - z;
+}
+
+float
+DEMandelbox(vec3 z)
+{
+    float Scale = -3 + sin(time);
+    float level = iterationLevel(4., abs(Scale), 10);
+    int Iterations = int(ceil(level));
+    int coarseIterations = int(level);
+    vec3 offset = z;
+    float dr = 1.0;
+    float coarse = 0.;
+    for (int n = 0; n < Iterations; n++) {
+        if (n == coarseIterations) {
+            coarse = length(z) / abs(dr);
+        }
+        boxFold(z, dr);    // Reflect
+        sphereFold(z, dr); // Sphere Inversion
+
+        z = Scale * z + offset; // Scale & Translate
+        dr = dr * abs(Scale) + 1.0;
+    }
+    float r = length(z);
+    float result = r / abs(dr);
+    if (Iterations > coarseIterations) {
+        result = mix(coarse, result, level - float(coarseIterations));
+    }
+    orbitTrap.x = min(orbitTrap.x, pow(length(result - vec3(1, 0, 0)), 2.));
+    orbitTrap.y = min(orbitTrap.y, pow(length(result - vec3(0, 1, 0)), 2.));
+    orbitTrap.z = min(orbitTrap.z, pow(length(result - vec3(0, 0, 1)), 2.));
+    return result;
+}
+
+float
+DE(vec3 pos)
+{
+    if (fractal == FRACTAL_MANDELBULB)
+        return DEMandelbulb(pos);
+    if (fractal == FRACTAL_MENGER_SPONGE)
+        return DEMengerSponge(pos);
+    if (fractal == FRACTAL_JULIA)
+        return DEJulia(pos);
+    if (fractal == FRACTAL_MANDELBOX)
+        return DEMandelbox(pos);
+    return DEApollonian(pos);
+}
@@ -0,0 +1,21 @@
+#version 330 core
+
+#include "coloring.glsl"
+
+uniform sampler2D surface;  // Lighting, distance.
+uniform sampler2D traps;    // Orbit trap, glow distance.
+uniform sampler2D marching; // Normal (zero on miss), steps.
+
+out vec4 returnColor;
+
+void
+main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec4 surfaceSample = texelFetch(surface, pixel, 0);
+    vec4 trapsSample = texelFetch(traps, pixel, 0);
+    vec4 marchingSample = texelFetch(marching, pixel, 0);
+
+    returnColor =
+      vec4(colorSurface(surfaceSample, trapsSample, marchingSample), 1);
+}
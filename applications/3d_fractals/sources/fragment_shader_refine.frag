@@ -0,0 +1,33 @@
+#version 330 core
+
+#include "ray_marching.glsl"
+#include "coloring.glsl"
+
+uniform int sampleGrid; // Samples per pixel along each axis.
+
+flat in ivec2 refinedPixel;
+
+out vec4 returnColor;
+
+// Average color of a grid of camera rays spread over the pixel. Every ray is
+// shaded on its own since the coloring modes are not linear in the G-buffer
+// values.
+void
+main()
+{
+    vec3 color = vec3(0);
+    for (int y = 0; y < sampleGrid; y++) {
+        for (int x = 0; x < sampleGrid; x++) {
+            vec2 fragCoord =
+              vec2(refinedPixel) + (vec2(x, y) + .5) / float(sampleGrid);
+
+            resetRay();
+            vec4 traps;
+            vec4 marching;
+            vec4 surface = renderPixel(fragCoord, traps, marching);
+            color += colorSurface(surface, traps, marching);
+        }
+    }
+
+    returnColor = vec4(color / float(sampleGrid * sampleGrid), 1);
+}
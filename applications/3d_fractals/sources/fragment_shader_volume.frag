@@ -0,0 +1,20 @@
+#version 330 core
+
+#include "distance_estimators.glsl"
+
+uniform vec3 volumeOrigin; // Corner of the baked cube
+uniform float volumeSize;  // Side of the baked cube
+uniform int volumeResolution;
+uniform int slice;
+
+out float returnDistance;
+
+// Bakes one slice of the distance volume, sampled at voxel centers.
+void
+main()
+{
+    vec3 voxel = vec3(gl_FragCoord.xy, float(slice) + 0.5);
+    vec3 p = volumeOrigin + voxel / float(volumeResolution) * volumeSize;
+
+    returnDistance = DE(p);
+}
@@ -1,3 +1,7 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
 #include <cstdio>
 #include <filesystem>
 #include <fstream>
@@ -5,13 +9,16 @@
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <eigen3/Eigen/Dense>
+#include <flight_controller/flight_controller.h>
 #include <png.h>
 #include <unsupported/Eigen/OpenGLSupport>
 
+// Camera of the current frame, read from `controller`.
 Eigen::Vector3f position = Eigen::Vector3f::Zero();
 Eigen::Vector3f direction = Eigen::Vector3f::UnitX();
 Eigen::Matrix3f basis = Eigen::Matrix3f::Identity();
@@ -28,6 +35,25 @@ readFile(const std::string& filePath)
     return stringStream.str();
 }
 
+// Reads a shader and inlines the files of its `#include "file"` lines.
+std::string
+readShader(const std::string& filePath)
+{
+    std::ifstream fileStream(filePath);
+    std::stringstream stringStream;
+    std::string line;
+    while (std::getline(fileStream, line)) {
+        if (line.rfind("#include \"", 0) == 0) {
+            size_t begin = line.find('"') + 1;
+            size_t end = line.rfind('"');
+            stringStream << readShader(line.substr(begin, end - begin));
+        } else {
+            stringStream << line << '\n';
+        }
+    }
+    return stringStream.str();
+}
+
 GLuint
 compileShader(GLenum shaderType, const std::string& shaderSource)
 {
@@ -74,6 +100,373 @@ createShaderProgram(const std::string& vertexShaderSource,
     return shaderProgram;
 }
 
+// Program without a fragment stage whose geometry shader output `pixel` is
+// captured with transform feedback.
+GLuint
+createCompactionProgram(const std::string& vertexShaderSource,
+                        const std::string& geometryShaderSource)
+{
+    GLuint vertexShader = compileShader(GL_VERTEX_SHADER, vertexShaderSource);
+    GLuint geometryShader =
+      compileShader(GL_GEOMETRY_SHADER, geometryShaderSource);
+
+    GLuint shaderProgram = glCreateProgram();
+    glAttachShader(shaderProgram, vertexShader);
+    glAttachShader(shaderProgram, geometryShader);
+    const char* varyings[] = { "pixel" };
+    glTransformFeedbackVaryings(
+      shaderProgram, 1, varyings, GL_INTERLEAVED_ATTRIBS);
+    glLinkProgram(shaderProgram);
+
+    GLint success;
+    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
+    if (!success) {
+        GLchar infoLog[512];
+        glGetProgramInfoLog(shaderProgram, 512, nullptr, infoLog);
+        std::cerr << "Shader program linking error: " << infoLog << std::endl;
+    }
+
+    glDeleteShader(vertexShader);
+    glDeleteShader(geometryShader);
+
+    return shaderProgram;
+}
+
+GLuint
+createComputeProgram(const std::string& computeShaderSource)
+{
+    GLuint computeShader =
+      compileShader(GL_COMPUTE_SHADER, computeShaderSource);
+
+    GLuint shaderProgram = glCreateProgram();
+    glAttachShader(shaderProgram, computeShader);
+    glLinkProgram(shaderProgram);
+
+    GLint success;
+    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
+    if (!success) {
+        GLchar infoLog[512];
+        glGetProgramInfoLog(shaderProgram, 512, nullptr, infoLog);
+        std::cerr << "Shader program linking error: " << infoLog << std::endl;
+    }
+
+    glDeleteShader(computeShader);
+
+    return shaderProgram;
+}
+
+// Targets of the ray marching pass, see the outputs of `fragment_shader.frag`.
+struct GBuffer
+{
+    GLuint framebuffer = 0;
+    GLuint surface = 0;
+    GLuint traps = 0;
+    GLuint marching = 0;
+    int width = 0;
+    int height = 0;
+};
+
+GLuint
+createTargetTexture(int width, int height)
+{
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D,
+                 0,
+                 GL_RGBA16F,
+                 width,
+                 height,
+                 0,
+                 GL_RGBA,
+                 GL_FLOAT,
+                 nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    return texture;
+}
+
+GBuffer
+createGBuffer(int width, int height)
+{
+    GBuffer gBuffer;
+    gBuffer.width = width;
+    gBuffer.height = height;
+    gBuffer.surface = createTargetTexture(width, height);
+    gBuffer.traps = createTargetTexture(width, height);
+    gBuffer.marching = createTargetTexture(width, height);
+
+    glGenFramebuffers(1, &gBuffer.framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, gBuffer.framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER,
+                           GL_COLOR_ATTACHMENT0,
+                           GL_TEXTURE_2D,
+                           gBuffer.surface,
+                           0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER,
+                           GL_COLOR_ATTACHMENT1,
+                           GL_TEXTURE_2D,
+                           gBuffer.traps,
+                           0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER,
+                           GL_COLOR_ATTACHMENT2,
+                           GL_TEXTURE_2D,
+                           gBuffer.marching,
+                           0);
+    GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0,
+                             GL_COLOR_ATTACHMENT1,
+                             GL_COLOR_ATTACHMENT2 };
+    glDrawBuffers(3, drawBuffers);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Framebuffer is incomplete" << std::endl;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    return gBuffer;
+}
+
+void
+deleteGBuffer(GBuffer& gBuffer)
+{
+    GLuint textures[] = { gBuffer.surface, gBuffer.traps, gBuffer.marching };
+    glDeleteTextures(3, textures);
+    glDeleteFramebuffers(1, &gBuffer.framebuffer);
+    gBuffer = GBuffer{};
+}
+
+using Color = std::array<float, 3>;
+
+struct Palette
+{
+    const char* name;
+    std::vector<Color> stops;
+};
+
+// Palettes are sampled cyclically, so each one ends on its first stop.
+std::vector<Palette> palettes = {
+    { "Ocean",
+      { { 0, 0.03, 0.4 },
+        { 0.1, 0.4, 0.8 },
+        { 0.9, 1, 1 },
+        { 1, 0.7, 0 },
+        { 0, 0.03, 0.4 } } },
+    { "Fire",
+      { { 0.1, 0, 0 }, { 1, 0.3, 0 }, { 1, 1, 0.4 }, { 1, 0.3, 0 }, { 0.1, 0, 0 } } },
+    { "Violet",
+      { { 0.2, 0, 0.3 }, { 0.9, 0.2, 0.6 }, { 1, 0.9, 0.8 }, { 0.2, 0, 0.3 } } },
+};
+
+const char* coloringNames[] = { "lighting", "orbit trap", "palette",
+                                "depth",    "occlusion",  "normal" };
+
+// Samples the palette gradient into a 256x1 texture.
+GLuint
+createPaletteTexture(const Palette& palette)
+{
+    int size = 256;
+    std::vector<unsigned char> pixels(size * 3);
+    for (int i = 0; i < size; i++) {
+        float t = (float)i / (size - 1) * (palette.stops.size() - 1);
+        int stop = std::min((int)t, (int)palette.stops.size() - 2);
+        float fraction = t - stop;
+        for (int channel = 0; channel < 3; channel++) {
+            float a = palette.stops[stop][channel];
+            float b = palette.stops[stop + 1][channel];
+            pixels[i * 3 + channel] =
+              (unsigned char)std::lround((a + (b - a) * fraction) * 255.0f);
+        }
+    }
+
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D,
+                 0,
+                 GL_RGB8,
+                 size,
+                 1,
+                 0,
+                 GL_RGB,
+                 GL_UNSIGNED_BYTE,
+                 pixels.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    return texture;
+}
+
+// Binds the G-buffer to units 0 to 2 and sets the uniforms of
+// `coloring.glsl`.
+void
+setColoringUniforms(GLuint shaderProgram,
+                    GLuint paletteTexture,
+                    const GBuffer& gBuffer,
+                    int coloring)
+{
+    glUseProgram(shaderProgram);
+
+    GLuint textures[] = {
+        gBuffer.surface, gBuffer.traps, gBuffer.marching, paletteTexture
+    };
+    const char* names[] = { "surface", "traps", "marching", "palette" };
+    for (int i = 0; i < 4; i++) {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+        glUniform1i(glGetUniformLocation(shaderProgram, names[i]), i);
+    }
+    glActiveTexture(GL_TEXTURE0);
+
+    glUniform1i(glGetUniformLocation(shaderProgram, "coloring"), coloring);
+}
+
+// Colors the G-buffer into the bound framebuffer.
+void
+renderPalette(GLuint paletteProgram,
+              GLuint quadVAO,
+              GLuint paletteTexture,
+              const GBuffer& gBuffer,
+              int coloring)
+{
+    setColoringUniforms(paletteProgram, paletteTexture, gBuffer, coloring);
+
+    glBindVertexArray(quadVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+}
+
+// Pixels that get extra samples. A transform feedback pass writes the pixels
+// on depth, normal and lighting discontinuities of the G-buffer to `pixels`,
+// the refine pass colors them into consecutive texels of `packedTexture`, and
+// the scatter pass draws those colors back over their pixels.
+struct Refinement
+{
+    GLuint pixels = 0;
+    GLuint pixelsVAO = 0;
+    GLuint query = 0;
+    GLuint packedTexture = 0;
+    GLuint packedFramebuffer = 0;
+    int width = 0;
+    int height = 0;
+    int count = 0;
+};
+
+Refinement
+createRefinement(int width, int height)
+{
+    Refinement refinement;
+    refinement.width = width;
+    refinement.height = height;
+
+    refinement.packedTexture = createTargetTexture(width, height);
+    glGenFramebuffers(1, &refinement.packedFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, refinement.packedFramebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER,
+                           GL_COLOR_ATTACHMENT0,
+                           GL_TEXTURE_2D,
+                           refinement.packedTexture,
+                           0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Framebuffer is incomplete" << std::endl;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    glGenBuffers(1, &refinement.pixels);
+    glBindBuffer(GL_ARRAY_BUFFER, refinement.pixels);
+    glBufferData(GL_ARRAY_BUFFER,
+                 (GLsizeiptr)width * height * 2 * sizeof(GLint),
+                 nullptr,
+                 GL_DYNAMIC_COPY);
+
+    glGenVertexArrays(1, &refinement.pixelsVAO);
+    glBindVertexArray(refinement.pixelsVAO);
+    glVertexAttribIPointer(0, 2, GL_INT, 2 * sizeof(GLint), (void*)nullptr);
+    glEnableVertexAttribArray(0);
+
+    glGenQueries(1, &refinement.query);
+    return refinement;
+}
+
+void
+deleteRefinement(Refinement& refinement)
+{
+    glDeleteFramebuffers(1, &refinement.packedFramebuffer);
+    glDeleteTextures(1, &refinement.packedTexture);
+    glDeleteBuffers(1, &refinement.pixels);
+    glDeleteVertexArrays(1, &refinement.pixelsVAO);
+    glDeleteQueries(1, &refinement.query);
+    refinement = Refinement{};
+}
+
+// Persistent compute version of the ray marching pass, see
+// `compute_shader.comp`. Needs OpenGL 4.3.
+struct ComputeMarcher
+{
+    GLuint program = 0;
+    GLuint work = 0; // Ray counter shared by the invocations.
+};
+
+ComputeMarcher
+createComputeMarcher()
+{
+    ComputeMarcher marcher;
+    marcher.program =
+      createComputeProgram(readShader("compute_shader.comp"));
+
+    glGenBuffers(1, &marcher.work);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, marcher.work);
+    glBufferData(
+      GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    return marcher;
+}
+
+void
+deleteComputeMarcher(ComputeMarcher& marcher)
+{
+    glDeleteProgram(marcher.program);
+    glDeleteBuffers(1, &marcher.work);
+    marcher = ComputeMarcher{};
+}
+
+// Workgroups of 64 invocations that stay resident while rays are left. The
+// best count is what the device runs at once, which the API does not report,
+// so it is measured by `tuneComputeWorkgroups`.
+int computeWorkgroups = 256;
+
+// Marches the view into the G-buffer with the compute shader. The frame and
+// optimization uniforms of `marcher.program` must already be set.
+void
+marchCompute(const ComputeMarcher& marcher, const GBuffer& gBuffer)
+{
+    glUseProgram(marcher.program);
+
+    GLuint zero = 0;
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, marcher.work);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER,
+                      GL_R32UI,
+                      GL_RED_INTEGER,
+                      GL_UNSIGNED_INT,
+                      &zero);
+
+    GLuint textures[] = { gBuffer.surface, gBuffer.traps, gBuffer.marching };
+    for (int i = 0; i < 3; i++) {
+        glBindImageTexture(
+          i, textures[i], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+    }
+
+    glDispatchCompute(computeWorkgroups, 1, 1);
+
+    // The G-buffer is then sampled by the other passes and read back by the
+    // benchmark, and the ray counter is cleared again by the next dispatch.
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT |
+                    GL_SHADER_STORAGE_BARRIER_BIT |
+                    GL_BUFFER_UPDATE_BARRIER_BIT);
+}
+
 float quadVertices[] = { -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, -1.0f,
 
                          -1.0f, 1.0f, 1.0f,  -1.0f, 1.0f, 1.0f };
@@ -87,6 +480,54 @@ float movementY = {};
 
 bool keys[1024];
 
+FlightController::Controller* controller = nullptr;
+const char* cameraPathFile = "camera_path.bin";
+
+// Frame-stepped replays of the camera path show one frame per animation step
+// whatever the time frames take, so captures and path benchmarks see the
+// same frames on any machine.
+enum class Playback
+{
+    Off,
+    Capture,
+    Benchmark,
+};
+Playback playback = Playback::Off;
+
+int palette = 0;
+int coloring = 0;
+
+const char* fractalNames[] = {
+    "Mandelbulb", "Menger sponge", "Julia", "Apollonian", "Mandelbox"
+};
+int fractal = 3;
+bool relaxed = true;
+bool bounded = true;
+bool iterationLOD = true;
+bool volumeCache = true;
+bool timeFrozen = false;
+bool benchmarkRequested = false;
+
+// Set whenever the marched view changes, and `refinementDirty` whenever the
+// colors of the refined pixels do: the palette and coloring alone only shade
+// the G-buffer again.
+bool marchingDirty = true;
+bool refinementDirty = true;
+
+// Whether the G-buffer is marched by the compute shader instead of the
+// full-screen quad, which stays the fallback without OpenGL 4.3.
+bool computeSupported = false;
+bool computeMarching = false;
+bool computeTuned = false;
+
+// Adaptive antialiasing: pixels on discontinuities of the G-buffer are
+// rendered again with `sampleGrid`^2 rays.
+bool antialiasing = true;
+const int sampleGrid = 4;
+const float edgeDepthThreshold = 0.02f;
+const float edgeNormalThreshold = 0.9f;
+const float edgeContrast = 0.1f;
+
 void
 cursorPositionCallback(GLFWwindow* window, double xPosition, double yPosition)
 {
@@ -102,28 +543,20 @@ cursorPositionCallback(GLFWwindow* window, double xPosition, double yPosition)
 
         offsetX += (xPosition - lastPositionX) * zoom;
         offsetY += (yPosition - lastPositionY) * zoom;
+        marchingDirty = true;
     }
 
     float factor = 0.001;
-    Eigen::Matrix3f rotationX =
-      Eigen::AngleAxisf(-movementY * factor, rotation.col(0))
-        .toRotationMatrix();
-    Eigen::Matrix3f rotationY =
-      Eigen::AngleAxisf(-movementX * factor, rotation.col(1))
-        .toRotationMatrix();
-    Eigen::Matrix3f rotationZ =
-      Eigen::AngleAxisf(movementX * factor, rotation.col(2)).toRotationMatrix();
-
-    movementX = {};
-    movementY = {};
-
     if (keys[GLFW_KEY_LEFT_CONTROL]) {
-        rotation = rotationZ * rotation;
+        FlightController::turn(controller, 0, 0, movementX * factor);
     } else {
-        rotation = rotationX * rotation;
-        rotation = rotationY * rotation;
+        FlightController::turn(
+          controller, -movementY * factor, -movementX * factor, 0);
     }
 
+    movementX = {};
+    movementY = {};
+
     lastPositionX = xPosition;
     lastPositionY = yPosition;
 }
@@ -134,6 +567,19 @@ scrollCallback(GLFWwindow* window, double xOffset, double yOffset)
     // zoom -= yOffset * 0.01;
     // zoom -= yOffset * 0.05;
     zoom -= yOffset * 0.25;
+    marchingDirty = true;
+}
+
+void
+startPlayback(Playback use)
+{
+    if (FlightController::startFrameReplay(controller, cameraPathFile)) {
+        playback = use;
+        std::cout << (use == Playback::Capture ? "Capturing " : "Benchmarking ")
+                  << cameraPathFile << " frame by frame" << std::endl;
+    } else {
+        std::cout << "Could not load " << cameraPathFile << std::endl;
+    }
 }
 
 GLfloat xPos = 0.0f, yPos = 0.0f;
@@ -144,37 +590,622 @@ keyCallback(GLFWwindow* window, int key, int scancode, int action, int mode)
         keys[key] = true;
     else if (action == GLFW_RELEASE)
         keys[key] = false;
+
+    if (action == GLFW_PRESS || action == GLFW_RELEASE) {
+        bool active = action == GLFW_PRESS;
+        if (key == GLFW_KEY_W) {
+            FlightController::move(
+              controller, FlightController::Forward, active);
+        } else if (key == GLFW_KEY_S) {
+            FlightController::move(
+              controller, FlightController::Backward, active);
+        } else if (key == GLFW_KEY_A) {
+            FlightController::move(controller, FlightController::Left, active);
+        } else if (key == GLFW_KEY_D) {
+            FlightController::move(controller, FlightController::Right, active);
+        } else if (key == GLFW_KEY_LEFT_SHIFT) {
+            FlightController::move(controller, FlightController::Down, active);
+        } else if (key == GLFW_KEY_SPACE) {
+            FlightController::move(controller, FlightController::Up, active);
+        }
+    }
+
+    if (action == GLFW_PRESS && key == GLFW_KEY_M) {
+        coloring = (coloring + 1) % 6;
+        refinementDirty = true;
+        std::cout << "Coloring: " << coloringNames[coloring] << std::endl;
+    } else if (action == GLFW_PRESS && key == GLFW_KEY_P) {
+        palette = (palette + 1) % palettes.size();
+        refinementDirty = true;
+        std::cout << "Palette: " << palettes[palette].name << std::endl;
+    } else if (action == GLFW_PRESS && key == GLFW_KEY_F) {
+        fractal = (fractal + 1) % 5;
+        marchingDirty = true;
+        std::cout << "Fractal: " << fractalNames[fractal] << std::endl;
+    } else if (action == GLFW_PRESS && key == GLFW_KEY_O) {
+        relaxed = !relaxed;
+        marchingDirty = true;
+        std::cout << "Relaxed marching: " << (relaxed ? "on" : "off")
+                  << std::endl;
+    } else if (action == GLFW_PRESS && key == GLFW_KEY_B) {
+        bounded = !bounded;
+        marchingDirty = true;
+        std::cout << "Bounding volumes: " << (bounded ? "on" : "off")
+                  << std::endl;
+    } else if (action == GLFW_PRESS && key == GLFW_KEY_L) {
+        iterationLOD = !iterationLOD;
+        marchingDirty = true;
+        std::cout << "Iteration level of detail: "
+                  << (iterationLOD ? "on" : "off") << std::endl;
+    } else if (action == GLFW_PRESS && key == GLFW_KEY_V) {
+        volumeCache = !volumeCache;
+        marchingDirty = true;
+        std::cout << "Distance volume cache: " << (volumeCache ? "on" : "off")
+                  << std::endl;
+    } else if (action == GLFW_PRESS && key == GLFW_KEY_T) {
+        timeFrozen = !timeFrozen;
+        std::cout << "Time: " << (timeFrozen ? "frozen" : "running")
+                  << std::endl;
+    } else if (action == GLFW_PRESS && key == GLFW_KEY_X) {
+        antialiasing = !antialiasing;
+        marchingDirty = true;
+        std::cout << "Adaptive antialiasing: " << (antialiasing ? "on" : "off")
+                  << std::endl;
+    } else if (action == GLFW_PRESS && key == GLFW_KEY_C) {
+        if (computeSupported) {
+            computeMarching = !computeMarching;
+            marchingDirty = true;
+            std::cout << "Compute marching: "
+                      << (computeMarching ? "on" : "off") << std::endl;
+        } else {
+            std::cout << "Compute marching needs OpenGL 4.3" << std::endl;
+        }
+    } else if (action == GLFW_PRESS && key == GLFW_KEY_K &&
+               keys[GLFW_KEY_LEFT_CONTROL]) {
+        startPlayback(Playback::Benchmark);
+    } else if (action == GLFW_PRESS && key == GLFW_KEY_K) {
+        benchmarkRequested = true;
+    } else if (action == GLFW_PRESS && key == GLFW_KEY_R) {
+        if (FlightController::mode(controller) ==
+            FlightController::Mode::Recording) {
+            bool saved =
+              FlightController::stopRecording(controller, cameraPathFile);
+            std::cout << (saved ? "Camera path saved to " : "Could not save ")
+                      << cameraPathFile << std::endl;
+        } else {
+            FlightController::startRecording(controller);
+            std::cout << "Recording the camera path" << std::endl;
+        }
+    } else if (action == GLFW_PRESS && key == GLFW_KEY_G &&
+               keys[GLFW_KEY_LEFT_CONTROL]) {
+        startPlayback(Playback::Capture);
+    } else if (action == GLFW_PRESS && key == GLFW_KEY_G) {
+        bool replaying = FlightController::replay(controller, cameraPathFile);
+        std::cout << (replaying ? "Replaying " : "Could not load ")
+                  << cameraPathFile << std::endl;
+    }
+}
+
+struct MarchingStatistics
+{
+    double milliseconds = 0.0;
+    double steps = 0.0;
+    std::vector<float> surface;
+};
+
+// Renders the current view into the G-buffer a few times and reads back the
+// average time, the average number of primary ray steps and the lighting.
+// The view is marched by `marcher` if given, otherwise by `shaderProgram`.
+// Frames are timed between `glFinish` calls: timer queries miss the deferred
+// rasterization of software drivers like llvmpipe, which would flatter the
+// quad against the compute marcher.
+MarchingStatistics
+measureMarching(GLuint shaderProgram,
+                GLuint quadVAO,
+                const GBuffer& gBuffer,
+                const ComputeMarcher* marcher = nullptr)
+{
+    int frames = 5;
+    int pixelCount = gBuffer.width * gBuffer.height;
+
+    MarchingStatistics statistics;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, gBuffer.framebuffer);
+    glFinish();
+    double start = glfwGetTime();
+    for (int frame = 0; frame < frames; frame++) {
+        if (marcher) {
+            marchCompute(*marcher, gBuffer);
+        } else {
+            glUseProgram(shaderProgram);
+            glBindVertexArray(quadVAO);
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+        }
+    }
+    glFinish();
+    statistics.milliseconds = (glfwGetTime() - start) * 1e3 / frames;
+
+    statistics.surface.resize(pixelCount * 4);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glReadPixels(0,
+                 0,
+                 gBuffer.width,
+                 gBuffer.height,
+                 GL_RGBA,
+                 GL_FLOAT,
+                 statistics.surface.data());
+
+    std::vector<float> marching(pixelCount * 4);
+    glReadBuffer(GL_COLOR_ATTACHMENT2);
+    glReadPixels(0,
+                 0,
+                 gBuffer.width,
+                 gBuffer.height,
+                 GL_RGBA,
+                 GL_FLOAT,
+                 marching.data());
+    for (int i = 0; i < pixelCount; i++) {
+        statistics.steps += marching[i * 4 + 3];
+    }
+    statistics.steps /= pixelCount;
+
+    return statistics;
 }
 
+// Keeps the fastest persistent workgroup count on the current view. Too few
+// groups leave the device idle, too many pay their startup cost only to find
+// the ray counter exhausted.
 void
-doMovement()
+tuneComputeWorkgroups(GLuint shaderProgram,
+                      GLuint quadVAO,
+                      const ComputeMarcher& marcher,
+                      const GBuffer& gBuffer)
 {
-    // Object movement speed
-    // GLfloat speed = 0.05f;
-    GLfloat speed = 0.05f;
-    if (keys[GLFW_KEY_W]) {
-        // xPos += speed;
-        position -= rotation.col(2) * speed;
+    // The first run also pays for compiling the shader on some drivers.
+    marchCompute(marcher, gBuffer);
+
+    std::cout << "Compute workgroups:";
+    int bestCount = computeWorkgroups;
+    double bestTime = 0.0;
+    for (int count = 16; count <= 4096; count *= 4) {
+        computeWorkgroups = count;
+        double time =
+          measureMarching(shaderProgram, quadVAO, gBuffer, &marcher)
+            .milliseconds;
+        std::cout << " " << count << " " << time << " ms,";
+        if (bestTime == 0.0 || time < bestTime) {
+            bestCount = count;
+            bestTime = time;
+        }
     }
-    if (keys[GLFW_KEY_S]) {
-        // xPos -= speed;
-        position += rotation.col(2) * speed;
+    computeWorkgroups = bestCount;
+    computeTuned = true;
+    std::cout << " using " << computeWorkgroups << std::endl;
+}
+
+// Mean absolute difference of the lighting channels of two measurements.
+double
+lightingDifference(const MarchingStatistics& a, const MarchingStatistics& b)
+{
+    double difference = 0.0;
+    for (size_t i = 0; i < a.surface.size(); i += 4) {
+        for (int channel = 0; channel < 3; channel++) {
+            difference +=
+              std::abs(a.surface[i + channel] - b.surface[i + channel]);
+        }
     }
-    if (keys[GLFW_KEY_A]) {
-        // yPos -= speed;
-        position -= rotation.col(0) * speed;
+    return difference / (a.surface.size() / 4 * 3);
+}
+
+// Distance field baked around the camera while time is frozen, sampled by
+// `DECached` in `fragment_shader.frag` for far-field steps. Slices are baked a
+// few per frame into the back texture, which is swapped to the front once
+// complete, so rendering never waits for a bake.
+struct DistanceVolume
+{
+    struct Slot
+    {
+        GLuint texture = 0;
+        Eigen::Vector3f origin = Eigen::Vector3f::Zero();
+        int fractal = -1;
+        float time = 0.0f;
+    };
+
+    Slot slots[2];
+    GLuint framebuffer = 0;
+    int resolution = 128;
+    float size = 4.0f;
+    int slicesPerFrame = 8;
+
+    int front = 0;
+    bool ready = false;
+    bool baking = false;
+    int bakedSlices = 0;
+};
+
+DistanceVolume
+createDistanceVolume()
+{
+    DistanceVolume volume;
+
+    for (DistanceVolume::Slot& slot : volume.slots) {
+        glGenTextures(1, &slot.texture);
+        glBindTexture(GL_TEXTURE_3D, slot.texture);
+        glTexImage3D(GL_TEXTURE_3D,
+                     0,
+                     GL_R16F,
+                     volume.resolution,
+                     volume.resolution,
+                     volume.resolution,
+                     0,
+                     GL_RED,
+                     GL_FLOAT,
+                     nullptr);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
     }
-    if (keys[GLFW_KEY_D]) {
-        // yPos += speed;
-        position += rotation.col(0) * speed;
+
+    glGenFramebuffers(1, &volume.framebuffer);
+
+    return volume;
+}
+
+void
+deleteDistanceVolume(DistanceVolume& volume)
+{
+    for (DistanceVolume::Slot& slot : volume.slots) {
+        glDeleteTextures(1, &slot.texture);
     }
-    if (keys[GLFW_KEY_LEFT_SHIFT]) {
-        // yPos -= speed;
-        position -= rotation.col(1) * speed;
+    glDeleteFramebuffers(1, &volume.framebuffer);
+    volume = DistanceVolume{};
+}
+
+// Drops volumes that no longer match the scene, starts a new bake when the
+// camera approaches the faces of the current volume and bakes the next few
+// slices.
+void
+updateDistanceVolume(DistanceVolume& volume,
+                     GLuint volumeProgram,
+                     GLuint quadVAO,
+                     float time)
+{
+    if (!timeFrozen || !volumeCache) {
+        volume.ready = false;
+        volume.baking = false;
+        return;
+    }
+
+    DistanceVolume::Slot& front = volume.slots[volume.front];
+    DistanceVolume::Slot& back = volume.slots[1 - volume.front];
+
+    if (front.fractal != fractal || front.time != time) {
+        volume.ready = false;
+    }
+    if (back.fractal != fractal || back.time != time) {
+        volume.baking = false;
+    }
+
+    Eigen::Vector3f center =
+      front.origin + Eigen::Vector3f::Constant(volume.size / 2);
+    bool cameraNearFace =
+      (position - center).cwiseAbs().maxCoeff() > volume.size / 4;
+
+    if (!volume.baking && (!volume.ready || cameraNearFace)) {
+        back.origin = position - Eigen::Vector3f::Constant(volume.size / 2);
+        back.fractal = fractal;
+        back.time = time;
+        volume.baking = true;
+        volume.bakedSlices = 0;
+    }
+
+    if (!volume.baking) {
+        return;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, volume.framebuffer);
+    glViewport(0, 0, volume.resolution, volume.resolution);
+
+    glUseProgram(volumeProgram);
+    glUniform1f(glGetUniformLocation(volumeProgram, "time"), time);
+    glUniform1i(glGetUniformLocation(volumeProgram, "fractal"), fractal);
+    glUniform3f(glGetUniformLocation(volumeProgram, "volumeOrigin"),
+                back.origin.x(),
+                back.origin.y(),
+                back.origin.z());
+    glUniform1f(glGetUniformLocation(volumeProgram, "volumeSize"),
+                volume.size);
+    glUniform1i(glGetUniformLocation(volumeProgram, "volumeResolution"),
+                volume.resolution);
+    GLint sliceLocation = glGetUniformLocation(volumeProgram, "slice");
+
+    glBindVertexArray(quadVAO);
+    int lastSlice =
+      std::min(volume.bakedSlices + volume.slicesPerFrame, volume.resolution);
+    for (; volume.bakedSlices < lastSlice; volume.bakedSlices++) {
+        glFramebufferTextureLayer(GL_FRAMEBUFFER,
+                                  GL_COLOR_ATTACHMENT0,
+                                  back.texture,
+                                  0,
+                                  volume.bakedSlices);
+        glUniform1i(sliceLocation, volume.bakedSlices);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
     }
-    if (keys[GLFW_KEY_SPACE]) {
-        // yPos += speed;
-        position += rotation.col(1) * speed;
+
+    if (volume.bakedSlices == volume.resolution) {
+        volume.front = 1 - volume.front;
+        volume.ready = true;
+        volume.baking = false;
+    }
+}
+
+DistanceVolume volume;
+
+// Uploads the marching optimization switches as toggled by the user, or all
+// turned off for the baseline of `benchmark`.
+void
+setOptimizationUniforms(GLuint shaderProgram, bool baseline)
+{
+    glUseProgram(shaderProgram);
+    glUniform1i(glGetUniformLocation(shaderProgram, "relaxed"),
+                relaxed && !baseline);
+    glUniform1i(glGetUniformLocation(shaderProgram, "bounded"),
+                bounded && !baseline);
+    glUniform1i(glGetUniformLocation(shaderProgram, "iterationLOD"),
+                iterationLOD && !baseline);
+
+    const DistanceVolume::Slot& front = volume.slots[volume.front];
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_3D, front.texture);
+    glActiveTexture(GL_TEXTURE0);
+    glUniform1i(glGetUniformLocation(shaderProgram, "distanceVolume"), 4);
+    glUniform1i(glGetUniformLocation(shaderProgram, "volumeReady"),
+                volume.ready && front.fractal == fractal && !baseline);
+    glUniform3f(glGetUniformLocation(shaderProgram, "volumeOrigin"),
+                front.origin.x(),
+                front.origin.y(),
+                front.origin.z());
+    glUniform1f(glGetUniformLocation(shaderProgram, "volumeSize"),
+                volume.size);
+}
+
+// Uploads the camera and the view of the current frame.
+void
+setFrameUniforms(GLuint shaderProgram,
+                 int screenWidth,
+                 int screenHeight,
+                 float time)
+{
+    glUseProgram(shaderProgram);
+    glUniform2f(glGetUniformLocation(shaderProgram, "screenSize"),
+                (float)screenWidth,
+                (float)screenHeight);
+    glUniform2f(glGetUniformLocation(shaderProgram, "offset"),
+                (float)offsetX,
+                (float)offsetY);
+    glUniform3f(glGetUniformLocation(shaderProgram, "position"),
+                position.x(),
+                position.y(),
+                position.z());
+    glUniform(glGetUniformLocation(shaderProgram, "rotation"), rotation);
+    glUniform3f(glGetUniformLocation(shaderProgram, "direction"),
+                direction.x(),
+                direction.y(),
+                direction.z());
+    glUniform1f(glGetUniformLocation(shaderProgram, "zoom"), (float)zoom);
+    glUniform1f(glGetUniformLocation(shaderProgram, "time"), time);
+    glUniform1i(glGetUniformLocation(shaderProgram, "fractal"), fractal);
+    glUniform1f(glGetUniformLocation(shaderProgram, "footprintScale"), 1.0f);
+}
+
+// Flags the pixels on discontinuities of the G-buffer and compacts them into
+// `refinement.pixels`. Reading back the count waits for the pass, which is
+// short next to the refinement itself.
+void
+compactEdges(GLuint compactProgram,
+             GLuint emptyVAO,
+             Refinement& refinement,
+             const GBuffer& gBuffer)
+{
+    glUseProgram(compactProgram);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, gBuffer.surface);
+    glUniform1i(glGetUniformLocation(compactProgram, "surface"), 0);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, gBuffer.marching);
+    glUniform1i(glGetUniformLocation(compactProgram, "marching"), 1);
+    glActiveTexture(GL_TEXTURE0);
+    glUniform1f(glGetUniformLocation(compactProgram, "depthThreshold"),
+                edgeDepthThreshold);
+    glUniform1f(glGetUniformLocation(compactProgram, "normalThreshold"),
+                edgeNormalThreshold);
+    glUniform1f(glGetUniformLocation(compactProgram, "contrast"),
+                edgeContrast);
+
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, refinement.pixels);
+    glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, refinement.query);
+    glBeginTransformFeedback(GL_POINTS);
+    glBindVertexArray(emptyVAO);
+    glDrawArrays(GL_POINTS, 0, gBuffer.width * gBuffer.height);
+    glEndTransformFeedback();
+    glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glDisable(GL_RASTERIZER_DISCARD);
+
+    GLuint count;
+    glGetQueryObjectuiv(refinement.query, GL_QUERY_RESULT, &count);
+    refinement.count = (int)count;
+}
+
+// Renders and colors the compacted pixels with `sampleGrid`^2 rays each into
+// `refinement.packedTexture`. The frame and optimization uniforms of
+// `refineProgram` must already be set.
+void
+refinePixels(GLuint refineProgram,
+             const Refinement& refinement,
+             GLuint paletteTexture,
+             const GBuffer& gBuffer)
+{
+    setColoringUniforms(refineProgram, paletteTexture, gBuffer, coloring);
+    glUniform1i(glGetUniformLocation(refineProgram, "sampleGrid"), sampleGrid);
+    glUniform1f(glGetUniformLocation(refineProgram, "footprintScale"),
+                1.0f / sampleGrid);
+    glUniform1i(glGetUniformLocation(refineProgram, "scatter"), false);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, refinement.packedFramebuffer);
+    glViewport(0, 0, refinement.width, refinement.height);
+    glBindVertexArray(refinement.pixelsVAO);
+    glDrawArrays(GL_POINTS, 0, refinement.count);
+}
+
+// Draws the refined colors over their pixels in the bound framebuffer.
+void
+scatterRefinement(GLuint scatterProgram, const Refinement& refinement)
+{
+    glUseProgram(scatterProgram);
+    glUniform2f(glGetUniformLocation(scatterProgram, "screenSize"),
+                (float)refinement.width,
+                (float)refinement.height);
+    glUniform1i(glGetUniformLocation(scatterProgram, "scatter"), true);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, refinement.packedTexture);
+    glUniform1i(glGetUniformLocation(scatterProgram, "refined"), 0);
+
+    glBindVertexArray(refinement.pixelsVAO);
+    glDrawArrays(GL_POINTS, 0, refinement.count);
+}
+
+// Average GPU time in milliseconds of flagging, compacting and refining the
+// edges of the G-buffer.
+double
+measureRefinement(GLuint compactProgram,
+                  GLuint refineProgram,
+                  GLuint emptyVAO,
+                  Refinement& refinement,
+                  GLuint paletteTexture,
+                  const GBuffer& gBuffer)
+{
+    int frames = 5;
+
+    // The first run also pays for compiling the shaders on some drivers.
+    compactEdges(compactProgram, emptyVAO, refinement, gBuffer);
+    refinePixels(refineProgram, refinement, paletteTexture, gBuffer);
+
+    GLuint query;
+    glGenQueries(1, &query);
+    double milliseconds = 0.0;
+    for (int frame = 0; frame < frames; frame++) {
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        compactEdges(compactProgram, emptyVAO, refinement, gBuffer);
+        glEndQuery(GL_TIME_ELAPSED);
+        GLuint64 compaction;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &compaction);
+
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        refinePixels(refineProgram, refinement, paletteTexture, gBuffer);
+        glEndQuery(GL_TIME_ELAPSED);
+        GLuint64 refine;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &refine);
+
+        milliseconds += (double)(compaction + refine) / 1e6 / frames;
+    }
+    glDeleteQueries(1, &query);
+
+    return milliseconds;
+}
+
+// Compares the plain marcher against the currently enabled optimizations on
+// every estimator from the current camera, then reports the optimized frame
+// marched by the compute shader when supported and what the adaptive
+// antialiasing adds. Uniforms other than `fractal` and the optimization
+// switches must already be set on all programs.
+void
+benchmark(GLuint shaderProgram,
+          GLuint compactProgram,
+          GLuint refineProgram,
+          GLuint quadVAO,
+          GLuint emptyVAO,
+          Refinement& refinement,
+          const ComputeMarcher& marcher,
+          GLuint paletteTexture,
+          const GBuffer& gBuffer)
+{
+    GLint fractalLocation = glGetUniformLocation(shaderProgram, "fractal");
+
+    // The distance volume only applies to the fractal it was baked for.
+    int shownFractal = fractal;
+    int pixelCount = gBuffer.width * gBuffer.height;
+
+    if (marcher.program) {
+        tuneComputeWorkgroups(shaderProgram, quadVAO, marcher, gBuffer);
+    }
+
+    for (int i = 0; i < 5; i++) {
+        fractal = i;
+        glUseProgram(shaderProgram);
+        glUniform1i(fractalLocation, i);
+
+        setOptimizationUniforms(shaderProgram, true);
+        MarchingStatistics baseline =
+          measureMarching(shaderProgram, quadVAO, gBuffer);
+
+        setOptimizationUniforms(shaderProgram, false);
+        MarchingStatistics optimized =
+          measureMarching(shaderProgram, quadVAO, gBuffer);
+
+        std::cout << fractalNames[i] << ": steps " << baseline.steps << " -> "
+                  << optimized.steps << ", " << baseline.milliseconds
+                  << " ms -> " << optimized.milliseconds
+                  << " ms, lighting difference "
+                  << lightingDifference(baseline, optimized) << std::endl;
+
+        if (marcher.program) {
+            glUseProgram(marcher.program);
+            glUniform1i(glGetUniformLocation(marcher.program, "fractal"), i);
+            setOptimizationUniforms(marcher.program, false);
+
+            // The first run also pays for compiling the shader on some
+            // drivers.
+            marchCompute(marcher, gBuffer);
+            MarchingStatistics compute =
+              measureMarching(shaderProgram, quadVAO, gBuffer, &marcher);
+            std::cout << "  compute marching: " << compute.milliseconds
+                      << " ms, speedup "
+                      << optimized.milliseconds / compute.milliseconds
+                      << "x, lighting difference "
+                      << lightingDifference(optimized, compute) << std::endl;
+        }
+
+        glUseProgram(refineProgram);
+        glUniform1i(glGetUniformLocation(refineProgram, "fractal"), i);
+        setOptimizationUniforms(refineProgram, false);
+        double refinementTime = measureRefinement(compactProgram,
+                                                  refineProgram,
+                                                  emptyVAO,
+                                                  refinement,
+                                                  paletteTexture,
+                                                  gBuffer);
+        std::cout << "  adaptive antialiasing: " << refinement.count
+                  << " pixels (" << 100.0 * refinement.count / pixelCount
+                  << "%) with " << sampleGrid * sampleGrid << " rays, +"
+                  << refinementTime << " ms ("
+                  << (optimized.milliseconds + refinementTime) /
+                       optimized.milliseconds
+                  << "x the single ray frame)" << std::endl;
+    }
+
+    fractal = shownFractal;
+    glUseProgram(shaderProgram);
+    glUniform1i(fractalLocation, fractal);
+    glUseProgram(refineProgram);
+    glUniform1i(glGetUniformLocation(refineProgram, "fractal"), fractal);
+    if (marcher.program) {
+        glUseProgram(marcher.program);
+        glUniform1i(glGetUniformLocation(marcher.program, "fractal"), fractal);
     }
 }
 
@@ -278,16 +1309,25 @@ main()
     // Initialize GLFW and create a window
 
     glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
     int aspectW = 16;
     int aspectH = 9;
     // int aspectN = 200;
     int aspectN = 120;
-    GLFWwindow* window = glfwCreateWindow(
-      aspectW * aspectN, aspectH * aspectN, "Fractals", nullptr, nullptr);
+
+    // OpenGL 4.3 enables the compute marcher, everything else runs on 3.3.
+    GLFWwindow* window = nullptr;
+    int versions[][2] = { { 4, 3 }, { 3, 3 } };
+    for (const auto& version : versions) {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, version[0]);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, version[1]);
+        window = glfwCreateWindow(
+          aspectW * aspectN, aspectH * aspectN, "Fractals", nullptr, nullptr);
+        if (window != nullptr) {
+            break;
+        }
+    }
     if (window == nullptr) {
         std::cerr << "Failed to create GLFW window" << std::endl;
         glfwTerminate();
@@ -305,10 +1345,28 @@ main()
     // Load and compile shaders
 
     std::string vertexShaderSource = readFile("vertex_shader.vert");
-    std::string fragmentShaderSource = readFile("fragment_shader.frag");
+    std::string fragmentShaderSource = readShader("fragment_shader.frag");
 
     GLuint shaderProgram =
       createShaderProgram(vertexShaderSource, fragmentShaderSource);
+    GLuint paletteProgram = createShaderProgram(
+      vertexShaderSource, readShader("fragment_shader_palette.frag"));
+    GLuint volumeProgram = createShaderProgram(
+      vertexShaderSource, readShader("fragment_shader_volume.frag"));
+    GLuint compactProgram =
+      createCompactionProgram(readFile("vertex_shader_compact.vert"),
+                              readFile("geometry_shader_compact.geom"));
+    std::string refineVertexSource = readFile("vertex_shader_refine.vert");
+    GLuint refineProgram = createShaderProgram(
+      refineVertexSource, readShader("fragment_shader_refine.frag"));
+    GLuint scatterProgram = createShaderProgram(
+      refineVertexSource, readFile("fragment_shader_scatter.frag"));
+
+    computeSupported = GLEW_VERSION_4_3;
+    ComputeMarcher computeMarcher;
+    if (computeSupported) {
+        computeMarcher = createComputeMarcher();
+    }
 
     GLuint quadVBO;
     glGenBuffers(1, &quadVBO);
@@ -324,9 +1382,20 @@ main()
       0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)nullptr);
     glEnableVertexAttribArray(0);
 
-    glUseProgram(shaderProgram);
-    glBindVertexArray(quadVAO);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
+    // Attribute-less draws (the edge compaction) still need a bound VAO.
+    GLuint emptyVAO;
+    glGenVertexArrays(1, &emptyVAO);
+
+    std::vector<GLuint> paletteTextures;
+    for (const Palette& palette : palettes) {
+        paletteTextures.push_back(createPaletteTexture(palette));
+    }
+
+    GBuffer gBuffer;
+    Refinement refinement;
+    volume = createDistanceVolume();
+
+    controller = FlightController::make();
 
     glfwSetScrollCallback(window, scrollCallback);
     glfwSetCursorPosCallback(window, cursorPositionCallback);
@@ -350,81 +1419,166 @@ main()
     float deltaTime = 0.025f;
     float time = 0.f;
 
+    size_t playbackFrame = 0;
+    double playbackMilliseconds = 0.0;
+    double playbackWorstMilliseconds = 0.0;
+
     // Rendering loop
 
     while (!glfwWindowShouldClose(window)) {
-        // Clear the screen
-
-        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
-
         int screenWidth, screenHeight;
         glfwGetFramebufferSize(window, &screenWidth, &screenHeight);
-        GLint screenSizeLocation =
-          glGetUniformLocation(shaderProgram, "screenSize");
-        glUseProgram(shaderProgram);
-        glUniform2f(
-          screenSizeLocation, (float)screenWidth, (float)screenHeight);
 
-        GLint offsetLocation = glGetUniformLocation(shaderProgram, "offset");
-        glUseProgram(shaderProgram);
-        glUniform2f(offsetLocation, (float)offsetX, (float)offsetY);
+        FlightController::Snapshot camera = FlightController::read(controller);
+        Playback shownPlayback = playback;
+        if (playback != Playback::Off &&
+            !FlightController::replayFrame(
+              controller, playbackFrame, 1.0f / deltaTime, camera)) {
+            if (playback == Playback::Benchmark && playbackFrame > 0) {
+                std::cout << "Path benchmark: " << playbackFrame
+                          << " frames, "
+                          << playbackMilliseconds / playbackFrame
+                          << " ms per frame, worst "
+                          << playbackWorstMilliseconds << " ms" << std::endl;
+            } else if (playback == Playback::Capture) {
+                std::cout << "Captured " << playbackFrame << " frames to "
+                          << directoryPath << std::endl;
+            }
+            playback = shownPlayback = Playback::Off;
+            playbackFrame = 0;
+            playbackMilliseconds = 0.0;
+            playbackWorstMilliseconds = 0.0;
+        }
+        auto frameStart = std::chrono::steady_clock::now();
+        if (camera.position != position || camera.rotation != rotation) {
+            marchingDirty = true;
+        }
+        position = camera.position;
+        rotation = camera.rotation;
+
+        if (gBuffer.width != screenWidth || gBuffer.height != screenHeight) {
+            deleteGBuffer(gBuffer);
+            gBuffer = createGBuffer(screenWidth, screenHeight);
+            deleteRefinement(refinement);
+            refinement = createRefinement(screenWidth, screenHeight);
+            marchingDirty = true;
+        }
 
-        // GLint positionLocation = glGetUniformLocation(shaderProgram,
-        // "position"); glUseProgram(shaderProgram);
-        // glUniform2f(positionLocation, (float) xPos, (float) yPos);
+        bool volumeReady = volume.ready;
+        updateDistanceVolume(volume, volumeProgram, quadVAO, time);
+        if (volume.ready != volumeReady) {
+            marchingDirty = true;
+        }
 
-        GLint positionLocation =
-          glGetUniformLocation(shaderProgram, "position");
-        glUseProgram(shaderProgram);
-        glUniform3f(positionLocation, position.x(), position.y(), position.z());
+        glBindFramebuffer(GL_FRAMEBUFFER, gBuffer.framebuffer);
+        glViewport(0, 0, screenWidth, screenHeight);
+        setFrameUniforms(shaderProgram, screenWidth, screenHeight, time);
+        setFrameUniforms(refineProgram, screenWidth, screenHeight, time);
+        setOptimizationUniforms(refineProgram, false);
+        if (computeSupported) {
+            setFrameUniforms(
+              computeMarcher.program, screenWidth, screenHeight, time);
+            setOptimizationUniforms(computeMarcher.program, false);
+        }
+        setOptimizationUniforms(shaderProgram, false);
+
+        if (benchmarkRequested) {
+            benchmark(shaderProgram,
+                      compactProgram,
+                      refineProgram,
+                      quadVAO,
+                      emptyVAO,
+                      refinement,
+                      computeMarcher,
+                      paletteTextures[palette],
+                      gBuffer);
+            benchmarkRequested = false;
+            marchingDirty = true;
+        }
 
-        GLint rotationLocation =
-          glGetUniformLocation(shaderProgram, "rotation");
-        glUseProgram(shaderProgram);
-        // glUniformMatrix3fv(rotationLocation, 1, GL_FALSE, rotation.data());
-        glUniform(rotationLocation, rotation);
+        // Render the fractal
 
-        GLint directionLocation =
-          glGetUniformLocation(shaderProgram, "direction");
-        glUseProgram(shaderProgram);
-        glUniform3f(
-          directionLocation, direction.x(), direction.y(), direction.z());
+        if (computeMarching && !computeTuned) {
+            tuneComputeWorkgroups(
+              shaderProgram, quadVAO, computeMarcher, gBuffer);
+        }
+        if (marchingDirty && computeMarching) {
+            marchCompute(computeMarcher, gBuffer);
+        } else if (marchingDirty) {
+            glBindFramebuffer(GL_FRAMEBUFFER, gBuffer.framebuffer);
+            glViewport(0, 0, screenWidth, screenHeight);
+            glUseProgram(shaderProgram);
+            glBindVertexArray(quadVAO);
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+        }
 
-        // std::cout << xPos << std::endl;
-        // std::cout << xPos << "  " << yPos << std::endl;
+        // Render the edges again with more rays, their colors are kept until
+        // the view or the coloring changes.
 
-        GLint zoomLocation = glGetUniformLocation(shaderProgram, "zoom");
-        glUseProgram(shaderProgram);
-        glUniform1f(zoomLocation, (float)zoom);
+        if (antialiasing && marchingDirty) {
+            compactEdges(compactProgram, emptyVAO, refinement, gBuffer);
+        }
+        if (antialiasing && (marchingDirty || refinementDirty)) {
+            refinePixels(
+              refineProgram, refinement, paletteTextures[palette], gBuffer);
+        }
+        marchingDirty = false;
+        refinementDirty = false;
 
-        GLint timeLocation = glGetUniformLocation(shaderProgram, "time");
-        glUseProgram(shaderProgram);
-        glUniform1f(timeLocation, time);
+        // Color the screen
 
-        // Render the screen
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
 
-        glUseProgram(shaderProgram);
-        glBindVertexArray(quadVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+        glViewport(0, 0, screenWidth, screenHeight);
+        renderPalette(paletteProgram,
+                      quadVAO,
+                      paletteTextures[palette],
+                      gBuffer,
+                      coloring);
+        if (antialiasing) {
+            scatterRefinement(scatterProgram, refinement);
+        }
 
         // Capture
 
-        GLubyte* pixels =
-          new GLubyte[3 * screenWidth * screenHeight]; // 3 channels (RGB)
-        glReadPixels(
-          0, 0, screenWidth, screenHeight, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+        if (shownPlayback == Playback::Capture) {
+            GLubyte* pixels =
+              new GLubyte[3 * screenWidth * screenHeight]; // 3 channels (RGB)
+            glReadPixels(0,
+                         0,
+                         screenWidth,
+                         screenHeight,
+                         GL_RGB,
+                         GL_UNSIGNED_BYTE,
+                         pixels);
 
-        if (false) {
             std::string fileName = padNumberWithZeros(frameNumber, 5) + ".png";
             std::filesystem::path filePath = directoryPath / fileName;
             savePNG(filePath.c_str(), pixels, screenWidth, screenHeight);
             frameNumber++;
+            delete[] pixels;
+        } else if (shownPlayback == Playback::Benchmark) {
+            glFinish();
+            double milliseconds =
+              std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - frameStart)
+                .count();
+            playbackMilliseconds += milliseconds;
+            playbackWorstMilliseconds =
+              std::max(playbackWorstMilliseconds, milliseconds);
+        }
+        if (shownPlayback != Playback::Off) {
+            playbackFrame++;
         }
 
         // Time
 
-        time += deltaTime;
+        if (!timeFrozen) {
+            time += deltaTime;
+            marchingDirty = true;
+        }
 
         // if (time >= 12. * 2. * M_PI) {
         //     break;
@@ -436,13 +1590,24 @@ main()
 
         glfwSwapBuffers(window);
         glfwPollEvents();
-        doMovement();
         rotate();
     }
 
     // Cleanup
 
+    deleteGBuffer(gBuffer);
+    deleteRefinement(refinement);
+    deleteComputeMarcher(computeMarcher);
+    deleteDistanceVolume(volume);
+    FlightController::free(controller);
+    glDeleteTextures(paletteTextures.size(), paletteTextures.data());
+
     glDeleteProgram(shaderProgram);
+    glDeleteProgram(paletteProgram);
+    glDeleteProgram(volumeProgram);
+    glDeleteProgram(compactProgram);
+    glDeleteProgram(refineProgram);
+    glDeleteProgram(scatterProgram);
     glfwTerminate();
 
     return 0;
@@ -0,0 +1,348 @@
+// Camera rays, marching and lighting shared by the shaders that render the
+// fractals. Included with `#include "ray_marching.glsl"` after the version
+// line.
+
+#include "distance_estimators.glsl"
+
+uniform vec2 screenSize; // Width and height of the shader
+uniform vec2 offset;
+uniform float zoom;
+uniform vec3 position;
+uniform vec3 direction;
+uniform mat3 rotation;
+uniform bool relaxed;
+uniform bool bounded;
+uniform bool iterationLOD;
+uniform float footprintScale; // Side of a ray's footprint in pixels
+uniform bool volumeReady;
+uniform sampler3D distanceVolume;
+uniform vec3 volumeOrigin; // Corner of the baked cube
+uniform float volumeSize;  // Side of the baked cube
+
+// Constants
+#define PI 3.1415925359
+#define TWO_PI 6.2831852
+#define MARCHING_MAX_STEPS 100
+#define MARCHING_MAX_DISTANCE 10.
+#define MARCHING_SURFACE_DISTANCE .0005
+#define MARCHING_RELAXATION 1.4
+
+bool escapedForGlow = false;
+float minimumDistanceForGlow = 1e9;
+int stepsForOcclusion = 0;
+
+vec3 lighting = vec3(0);
+
+// Radius of the cone covered by a pixel at unit distance from the camera.
+float
+pixelRadius()
+{
+    return 0.5 / screenSize.y;
+}
+
+// Lets the estimators skip the iterations whose details are smaller than the
+// footprint of a ray at `distance` from the camera, which is a fraction of a
+// pixel when several rays share a pixel.
+void
+setDetailSize(float distance)
+{
+    detailSize =
+      iterationLOD ? 2. * distance * pixelRadius() * footprintScale : 0.;
+}
+
+// Distance bound from the baked volume where the surface is a few voxels
+// away, otherwise the exact estimator. Trilinear interpolation can be off by
+// up to a voxel diagonal, which is subtracted to keep the step conservative.
+float
+DECached(vec3 p)
+{
+    if (volumeReady) {
+        vec3 uvw = (p - volumeOrigin) / volumeSize;
+        if (all(greaterThan(uvw, vec3(0.))) && all(lessThan(uvw, vec3(1.)))) {
+            float voxelDiagonal =
+              volumeSize / float(textureSize(distanceVolume, 0).x) * sqrt(3.);
+            float d = texture(distanceVolume, uvw).r - voxelDiagonal;
+            if (d > 2. * voxelDiagonal) {
+                return d;
+            }
+        }
+    }
+    return DE(p);
+}
+
+vec3
+getNormal(vec3 p)
+{
+    const float h = 0.0001;
+    const vec2 k = vec2(1, -1);
+    return normalize(k.xyy * DE(p + k.xyy * h) + k.yyx * DE(p + k.yyx * h) +
+                     k.yxy * DE(p + k.yxy * h) + k.xxx * DE(p + k.xxx * h));
+}
+
+float
+rayMarching(vec3 rayOrigin,
+            vec3 rayDirection,
+            float maxDistance,
+            float coneDistance)
+{
+    float distanceFromOrigin = 0.;
+    for (int i = 0; i < MARCHING_MAX_STEPS; i++) {
+        vec3 p = rayOrigin + rayDirection * distanceFromOrigin;
+        setDetailSize(coneDistance + distanceFromOrigin);
+        float ds = DECached(p);
+        distanceFromOrigin += ds;
+        minimumDistanceForGlow = min(minimumDistanceForGlow, ds);
+        stepsForOcclusion = i;
+        if (ds < MARCHING_SURFACE_DISTANCE) {
+            break;
+        }
+        if (distanceFromOrigin > maxDistance) {
+            escapedForGlow = true;
+            break;
+        }
+    }
+
+    return distanceFromOrigin;
+}
+
+// Over-relaxed sphere tracing (Keinert et al., "Enhanced Sphere Tracing"):
+// steps are lengthened by `MARCHING_RELAXATION` as long as consecutive
+// unbounding spheres overlap, otherwise the step is taken back and marching
+// continues with plain steps. A hit is accepted once the distance bound drops
+// below the pixel cone radius, so distant surfaces are not refined beyond what
+// a pixel can show. `coneDistance` is how far the ray origin already is from
+// the camera along the cone (non-zero for shadow rays).
+float
+rayMarchingRelaxed(vec3 rayOrigin,
+                   vec3 rayDirection,
+                   float maxDistance,
+                   float coneDistance)
+{
+    float omega = MARCHING_RELAXATION;
+    float distanceFromOrigin = 0.;
+    float previousRadius = 0.;
+    float stepLength = 0.;
+
+    for (int i = 0; i < MARCHING_MAX_STEPS; i++) {
+        vec3 p = rayOrigin + rayDirection * distanceFromOrigin;
+        setDetailSize(coneDistance + distanceFromOrigin);
+        float ds = DECached(p);
+        stepsForOcclusion = i;
+
+        bool overshot = omega > 1. && ds + previousRadius < stepLength;
+        if (overshot) {
+            // Lands back inside the unbounding sphere of the previous point.
+            stepLength -= omega * stepLength;
+            omega = 1.;
+        } else {
+            stepLength = ds * omega;
+            minimumDistanceForGlow = min(minimumDistanceForGlow, ds);
+
+            float threshold =
+              max(MARCHING_SURFACE_DISTANCE,
+                  (coneDistance + distanceFromOrigin) * pixelRadius());
+            if (ds < threshold) {
+                break;
+            }
+        }
+        previousRadius = ds;
+
+        distanceFromOrigin += stepLength;
+        if (distanceFromOrigin > maxDistance) {
+            escapedForGlow = true;
+            break;
+        }
+    }
+
+    return distanceFromOrigin;
+}
+
+// Entry and exit distances of a ray through a sphere at the origin, the entry
+// is past the exit when the ray misses.
+vec2
+intersectSphere(vec3 rayOrigin, vec3 rayDirection, float radius)
+{
+    float b = dot(rayOrigin, rayDirection);
+    float c = dot(rayOrigin, rayOrigin) - radius * radius;
+    float discriminant = b * b - c;
+    if (discriminant < 0.) {
+        return vec2(1., 0.);
+    }
+    float root = sqrt(discriminant);
+    return vec2(-b - root, -b + root);
+}
+
+// Same as `intersectSphere` for an axis-aligned box centered at the origin.
+vec2
+intersectBox(vec3 rayOrigin, vec3 rayDirection, vec3 halfSize)
+{
+    vec3 inverseDirection = 1. / rayDirection;
+    vec3 t0 = (-halfSize - rayOrigin) * inverseDirection;
+    vec3 t1 = (halfSize - rayOrigin) * inverseDirection;
+    vec3 tMin = min(t0, t1);
+    vec3 tMax = max(t0, t1);
+    return vec2(max(max(tMin.x, tMin.y), tMin.z),
+                min(min(tMax.x, tMax.y), tMax.z));
+}
+
+// Interval of the ray inside the region that contains the current fractal,
+// padded a little so that hit thresholds never reach outside of it.
+vec2
+intersectBounds(vec3 rayOrigin, vec3 rayDirection)
+{
+    if (fractal == FRACTAL_MANDELBULB) {
+        // Points farther than 2^(1 / (power - 1)) escape, the power is >= 3.
+        return intersectSphere(rayOrigin, rayDirection, 1.5);
+    }
+    if (fractal == FRACTAL_MENGER_SPONGE) {
+        return intersectBox(rayOrigin, rayDirection, vec3(1.05));
+    }
+    if (fractal == FRACTAL_JULIA) {
+        return intersectSphere(rayOrigin, rayDirection, 2.0);
+    }
+    if (fractal == FRACTAL_MANDELBOX) {
+        // With the negative scales used here the box stays inside the cube
+        // of half size 2 (checked numerically for scales from -4 to -2).
+        return intersectBox(rayOrigin, rayDirection, vec3(2.1));
+    }
+    // The Apollonian gasket tiles the whole space.
+    return vec2(-1e9, 1e9);
+}
+
+// Marches only the part of the ray inside the bounding volume of the fractal:
+// rays that miss it never evaluate the estimator, and the others start at the
+// entry point. Like the marchers, returns more than `maxDistance` on escape.
+float
+march(vec3 rayOrigin, vec3 rayDirection, float maxDistance, float coneDistance)
+{
+    float start = 0.;
+    float end = maxDistance;
+    if (bounded) {
+        vec2 interval = intersectBounds(rayOrigin, rayDirection);
+        start = max(interval.x, 0.);
+        end = min(interval.y, maxDistance);
+        if (start >= end) {
+            escapedForGlow = true;
+            return maxDistance + 1.;
+        }
+    }
+
+    vec3 origin = rayOrigin + rayDirection * start;
+    float distance =
+      relaxed
+        ? rayMarchingRelaxed(
+            origin, rayDirection, end - start, coneDistance + start)
+        : rayMarching(
+            origin, rayDirection, end - start, coneDistance + start);
+
+    if (distance > end - start) {
+        return max(start + distance, maxDistance + 1.);
+    }
+    return start + distance;
+}
+
+vec3 lookDirection = vec3(0, 0, -1);
+
+float
+render(vec3 rayOrigin, vec3 rayDirection, out vec4 traps, out vec4 marching)
+{
+
+    float distance =
+      march(rayOrigin, rayDirection, MARCHING_MAX_DISTANCE, 0.);
+
+    // Normal and shadow evaluations below keep accumulating into the globals,
+    // so the primary ray values are stored right away.
+    traps = vec4(min(orbitTrap, vec3(1e4)), minimumDistanceForGlow);
+    marching = vec4(0, 0, 0, stepsForOcclusion);
+
+    vec3 p = rayOrigin + rayDirection * distance;
+
+    if (distance < MARCHING_MAX_DISTANCE) {
+
+        setDetailSize(distance);
+        vec3 normal = getNormal(p);
+        marching.xyz = normal;
+
+        vec3 lightColor = vec3(1);
+        vec3 lightSource = rayOrigin - p;
+        float diffuseStrength = max(0, dot(normalize(lightSource), normal));
+        vec3 diffuse = lightColor * diffuseStrength;
+
+        vec3 viewSource = normalize(p);
+        vec3 reflectSource = normalize(reflect(-lightSource, normal));
+        float specularStrength = max(0, dot(viewSource, reflectSource));
+        specularStrength = pow(specularStrength, 64);
+        vec3 specular = specularStrength * lightColor;
+
+        lighting = diffuse * 0.75 + specular * 0.25;
+
+        vec3 lightDirection = normalize(lookDirection);
+        float distanceToLightSource = length(lightSource);
+        // The shadow ray has to start clear of the hit threshold used above.
+        float shadowOffset =
+          relaxed ? max(0.005, 2. * distance * pixelRadius()) : 0.005;
+        vec3 ro = p + normal * shadowOffset;
+        vec3 rd = -lightDirection;
+        float d = march(ro, rd, distanceToLightSource, distance);
+        vec3 a = lightDirection;
+        vec3 b = p - rayOrigin;
+        // bool isCone = acos(dot(a, b) / (length(a) * length(b))) > PI / 8;
+        bool isCone = true;
+        if (d < distanceToLightSource && isCone) {
+            lighting = lighting * vec3(0.25);
+        }
+    }
+
+    return distance;
+}
+
+// Clears the state that the estimators and marchers accumulate along a ray,
+// for shaders that render more than one ray.
+void
+resetRay()
+{
+    escapedForGlow = false;
+    minimumDistanceForGlow = 1e9;
+    stepsForOcclusion = 0;
+    lighting = vec3(0);
+    orbitTrap = vec3(1e9);
+    detailSize = 0.;
+}
+
+// Renders the camera ray through `fragCoord` (window coordinates) and returns
+// the lighting and distance, the other G-buffer values go to `traps` and
+// `marching`.
+vec4
+renderPixel(vec2 fragCoord, out vec4 traps, out vec4 marching)
+{
+    vec2 uv = (fragCoord - .5 * screenSize.xy) / screenSize.y;
+
+    vec3 rayOrigin = vec3(0, 0, 1);
+    vec3 rayDirection = normalize(vec3(uv.x, uv.y, -1.));
+
+    //     float rotationSensitivity = 0.5;
+    // #if 1
+    //     mat3 rotationX =
+    //       rotate(vec3(1, 0, 0),
+    //              2. * PI * offset.y / screenSize.y * rotationSensitivity -
+    //              PI);
+    //     mat3 rotationY = rotate(
+    //       vec3(0, 1, 0), 2. * PI * offset.x / screenSize.x *
+    //       rotationSensitivity);
+    // #else
+    //     mat3 rotationX = rotate(vec3(1, 0, 0), PI * sin(time / 12.));
+    //     mat3 rotationY = rotate(vec3(0, 1, 0), PI * cos(time / 12));
+    // #endif
+    //     mat3 rotation = rotationX * rotationY;
+
+    lookDirection = rotation * vec3(0, 0, -1);
+    rayDirection = rotation * rayDirection;
+    // rayOrigin = rotation * vec3(0, 0, 2) * zoom * 1.5;
+    // rayOrigin = rotation * vec3(0, 0, 1 - position.x) * zoom * 1.5;
+    // rayOrigin = rotation * vec3(0, 0, 2) * zoom * 1.5;
+    rayOrigin = position;
+
+    float distance = render(rayOrigin, rayDirection, traps, marching);
+
+    return vec4(lighting, distance);
+}
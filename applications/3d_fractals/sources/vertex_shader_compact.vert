@@ -0,0 +1,49 @@
+#version 330 core
+
+uniform sampler2D surface;  // Lighting, distance.
+uniform sampler2D marching; // Normal (zero on miss), steps.
+uniform float depthThreshold;  // Relative distance change.
+uniform float normalThreshold; // Cosine between neighboring normals.
+uniform float contrast;        // Lighting change, catches shadow edges.
+
+flat out ivec2 vertexPixel;
+flat out int vertexEdge;
+
+// One point per pixel of the G-buffer. A pixel is flagged for extra samples
+// when one of its eight neighbors hits a different surface: one ray hits and
+// the other misses, the distances jump, or the normals diverge.
+void
+main()
+{
+    ivec2 size = textureSize(surface, 0);
+    ivec2 pixel = ivec2(gl_VertexID % size.x, gl_VertexID / size.x);
+
+    vec4 center = texelFetch(surface, pixel, 0);
+    vec3 normal = texelFetch(marching, pixel, 0).xyz;
+    bool hit = dot(normal, normal) > 0.;
+
+    bool edge = false;
+    for (int y = -1; y <= 1; y++) {
+        for (int x = -1; x <= 1; x++) {
+            ivec2 neighbor = clamp(pixel + ivec2(x, y), ivec2(0), size - 1);
+            vec4 neighborSurface = texelFetch(surface, neighbor, 0);
+            vec3 neighborNormal = texelFetch(marching, neighbor, 0).xyz;
+            bool neighborHit = dot(neighborNormal, neighborNormal) > 0.;
+
+            vec3 lightingChange = abs(neighborSurface.rgb - center.rgb);
+            edge = edge || neighborHit != hit ||
+                   max(max(lightingChange.r, lightingChange.g),
+                       lightingChange.b) > contrast;
+            if (hit && neighborHit) {
+                edge = edge ||
+                       abs(neighborSurface.a - center.a) >
+                         depthThreshold * center.a ||
+                       dot(neighborNormal, normal) < normalThreshold;
+            }
+        }
+    }
+
+    vertexPixel = pixel;
+    vertexEdge = int(edge);
+    gl_Position = vec4(0., 0., 0., 1.);
+}
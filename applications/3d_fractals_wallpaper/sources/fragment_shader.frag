@@ -51,7 +51,7 @@ DE(vec3 pos)
         z += pos;
 
         float s = sin(time);
-        float c = cos(time / 2 * PI);
+        float c = cos(time * 1.5);
         orbitTrap.x =
           min(orbitTrap.x, pow(length(z - vec3(1 * s, 0, 1 * c)), 2));
         orbitTrap.y = min(orbitTrap.y, pow(length(z - vec3(0, 1 * s, 0)), 2));
@@ -136,10 +136,34 @@ getNormal(vec3 p)
 
 vec3 lighting = vec3(0);
 
+// Entry and exit distances of a ray through a sphere at the origin, the entry
+// is past the exit when the ray misses.
+vec2
+intersectSphere(vec3 rayOrigin, vec3 rayDirection, float radius)
+{
+    float b = dot(rayOrigin, rayDirection);
+    float c = dot(rayOrigin, rayOrigin) - radius * radius;
+    float discriminant = b * b - c;
+    if (discriminant < 0.) {
+        return vec2(1., 0.);
+    }
+    float root = sqrt(discriminant);
+    return vec2(-b - root, -b + root);
+}
+
 float
 rayMarching(vec3 rayOrigin, vec3 rayDirection, float maxDistance)
 {
-    float distanceFromOrigin = 0.;
+    // Outside of this sphere the estimate stays above 0.4 for every power, so
+    // rays missing it neither hit nor glow and are skipped without marching.
+    vec2 bounds = intersectSphere(rayOrigin, rayDirection, 2.);
+    if (bounds.x >= bounds.y || bounds.y < 0.) {
+        escapedForGlow = true;
+        return maxDistance + 1.;
+    }
+
+    float end = min(bounds.y, maxDistance);
+    float distanceFromOrigin = max(bounds.x, 0.);
     for (int i = 0; i < MARCHING_MAX_STEPS; i++) {
         vec3 p = rayOrigin + rayDirection * distanceFromOrigin;
         float ds = DE(p);
@@ -149,9 +173,9 @@ rayMarching(vec3 rayOrigin, vec3 rayDirection, float maxDistance)
         if (ds < MARCHING_SURFACE_DISTANCE) {
             break;
         }
-        if (distanceFromOrigin > maxDistance) {
+        if (distanceFromOrigin > end) {
             escapedForGlow = true;
-            break;
+            return max(distanceFromOrigin, maxDistance + 1.);
         }
     }
 
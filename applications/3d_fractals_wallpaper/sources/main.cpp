@@ -3,12 +3,25 @@
 #include <Imlib2.h>
 #include <X11/Xatom.h>
 #include <X11/Xlib.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <random>
 #include <sstream>
 #include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
 
 std::string
 readFile(const std::string& filePath)
@@ -65,12 +78,453 @@ createShaderProgram(const std::string& vertexShaderSource,
     return shaderProgram;
 }
 
+// Loop cache
+//
+// Every `time` term of `fragment_shader.frag` repeats after `loopPeriod`, so
+// one period is rendered once into a file of palette-compressed frames and
+// later sessions only decode and blit them. The file starts with a
+// `FrameCacheHeader`, followed by `frameCount + 1` offsets of the frames and
+// the frames themselves: a palette of 256 RGB colors and the PackBits encoded
+// palette indices of the pixels.
+
+const float loopPeriod = 24 * M_PI;
+
+// Cached frames are downscaled by this factor in each direction and are
+// `cacheStride` live frames apart, which keeps a 1080p loop around 250 MB.
+const int cacheScale = 2;
+const int cacheStride = 2;
+
+const int cacheFramesPerSecond = 15;
+
+struct FrameCacheHeader
+{
+    char magic[8];
+    uint64_t shaderHash;
+    uint32_t width;
+    uint32_t height;
+    float period;
+    uint32_t frameCount;
+};
+
+const char frameCacheMagic[8] = { 'F', 'R', 'A', 'C', 'A', 'C', 'H', '1' };
+
+// FNV-1a.
+uint64_t
+hashString(const std::string& string, uint64_t hash = 14695981039346656037ull)
+{
+    for (unsigned char character : string) {
+        hash ^= character;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+std::filesystem::path
+frameCachePath(uint64_t shaderHash, int width, int height)
+{
+    std::filesystem::path directory;
+    if (const char* cacheHome = std::getenv("XDG_CACHE_HOME")) {
+        directory = cacheHome;
+    } else if (const char* home = std::getenv("HOME")) {
+        directory = std::filesystem::path(home) / ".cache";
+    } else {
+        directory = "/tmp";
+    }
+    directory /= "3d_fractals_wallpaper";
+
+    char name[64];
+    snprintf(name,
+             sizeof(name),
+             "%016llx-%dx%d.frames",
+             (unsigned long long)shaderHash,
+             width,
+             height);
+    return directory / name;
+}
+
+// Averages `scale` x `scale` blocks of an ARGB image.
+void
+downscale(const unsigned int* source,
+          int width,
+          int height,
+          int scale,
+          unsigned int* destination)
+{
+    int destinationWidth = width / scale;
+    int destinationHeight = height / scale;
+    for (int y = 0; y < destinationHeight; y++) {
+        for (int x = 0; x < destinationWidth; x++) {
+            unsigned int sum[3] = { 0, 0, 0 };
+            for (int dy = 0; dy < scale; dy++) {
+                const unsigned int* row =
+                  source + (y * scale + dy) * width + x * scale;
+                for (int dx = 0; dx < scale; dx++) {
+                    sum[0] += (row[dx] >> 16) & 0xFF;
+                    sum[1] += (row[dx] >> 8) & 0xFF;
+                    sum[2] += row[dx] & 0xFF;
+                }
+            }
+            unsigned int n = scale * scale;
+            destination[y * destinationWidth + x] =
+              (0xFF << 24) | (sum[0] / n << 16) | (sum[1] / n << 8) |
+              sum[2] / n;
+        }
+    }
+}
+
+// Reduces an ARGB image to 256 colors with median cut over a 15-bit color
+// histogram and appends the palette followed by the PackBits encoded indices
+// to `output`.
+void
+encodeFrame(const unsigned int* pixels,
+            int pixelCount,
+            std::vector<unsigned char>& output)
+{
+    auto binOf = [](unsigned int color) {
+        return ((color >> 9) & 0x7C00) | ((color >> 6) & 0x03E0) |
+               ((color >> 3) & 0x001F);
+    };
+
+    std::vector<unsigned int> histogram(1 << 15, 0);
+    for (int i = 0; i < pixelCount; i++) {
+        histogram[binOf(pixels[i])]++;
+    }
+
+    std::vector<int> bins;
+    for (int bin = 0; bin < (1 << 15); bin++) {
+        if (histogram[bin] > 0) {
+            bins.push_back(bin);
+        }
+    }
+
+    auto channel = [](int bin, int c) { return (bin >> (10 - 5 * c)) & 0x1F; };
+
+    struct Box
+    {
+        int begin;
+        int end;
+    };
+    std::vector<Box> boxes = { { 0, (int)bins.size() } };
+
+    // Splits the box with the widest channel range at its median pixel until
+    // there are 256 boxes or no box can be split.
+    while (boxes.size() < 256) {
+        int widestBox = -1;
+        int widestChannel = 0;
+        int widestRange = 0;
+        for (size_t b = 0; b < boxes.size(); b++) {
+            for (int c = 0; c < 3; c++) {
+                int minimum = 31;
+                int maximum = 0;
+                for (int i = boxes[b].begin; i < boxes[b].end; i++) {
+                    minimum = std::min(minimum, channel(bins[i], c));
+                    maximum = std::max(maximum, channel(bins[i], c));
+                }
+                if (maximum - minimum > widestRange) {
+                    widestBox = b;
+                    widestChannel = c;
+                    widestRange = maximum - minimum;
+                }
+            }
+        }
+        if (widestBox < 0) {
+            break;
+        }
+
+        Box box = boxes[widestBox];
+        std::sort(bins.begin() + box.begin,
+                  bins.begin() + box.end,
+                  [&](int a, int b) {
+                      return channel(a, widestChannel) <
+                             channel(b, widestChannel);
+                  });
+
+        unsigned long long total = 0;
+        for (int i = box.begin; i < box.end; i++) {
+            total += histogram[bins[i]];
+        }
+        unsigned long long accumulated = 0;
+        int split = box.begin + 1;
+        for (int i = box.begin; i < box.end - 1; i++) {
+            accumulated += histogram[bins[i]];
+            split = i + 1;
+            if (accumulated * 2 >= total) {
+                break;
+            }
+        }
+
+        boxes[widestBox].end = split;
+        boxes.push_back({ split, box.end });
+    }
+
+    std::vector<unsigned char> lookup(1 << 15, 0);
+    unsigned char palette[256 * 3] = {};
+    for (size_t b = 0; b < boxes.size(); b++) {
+        unsigned long long sum[3] = { 0, 0, 0 };
+        unsigned long long count = 0;
+        for (int i = boxes[b].begin; i < boxes[b].end; i++) {
+            int bin = bins[i];
+            for (int c = 0; c < 3; c++) {
+                sum[c] += (unsigned long long)histogram[bin] *
+                          (channel(bin, c) * 255 / 31);
+            }
+            count += histogram[bin];
+            lookup[bin] = b;
+        }
+        for (int c = 0; c < 3; c++) {
+            palette[b * 3 + c] = count > 0 ? sum[c] / count : 0;
+        }
+    }
+    output.insert(output.end(), palette, palette + sizeof(palette));
+
+    // PackBits: a control byte n < 128 is followed by n + 1 literal indices,
+    // n >= 128 by one index repeated n - 126 times.
+    std::vector<unsigned char> indices(pixelCount);
+    for (int i = 0; i < pixelCount; i++) {
+        indices[i] = lookup[binOf(pixels[i])];
+    }
+    int i = 0;
+    while (i < pixelCount) {
+        int run = 1;
+        while (i + run < pixelCount && run < 129 &&
+               indices[i + run] == indices[i]) {
+            run++;
+        }
+        if (run >= 2) {
+            output.push_back(run + 126);
+            output.push_back(indices[i]);
+            i += run;
+            continue;
+        }
+        int literals = 1;
+        while (i + literals < pixelCount && literals < 128 &&
+               (i + literals + 1 >= pixelCount ||
+                indices[i + literals] != indices[i + literals + 1])) {
+            literals++;
+        }
+        output.push_back(literals - 1);
+        output.insert(output.end(),
+                      indices.begin() + i,
+                      indices.begin() + i + literals);
+        i += literals;
+    }
+}
+
+// Decodes the `size` bytes of a frame, returns false if they do not hold
+// `pixelCount` pixels. Runs that go past the last pixel are cut.
+bool
+decodeFrame(const unsigned char* data,
+            size_t size,
+            int pixelCount,
+            unsigned int* pixels)
+{
+    if (size < 256 * 3) {
+        return false;
+    }
+    const unsigned char* end = data + size;
+
+    unsigned int palette[256];
+    for (int i = 0; i < 256; i++) {
+        palette[i] = (0xFF << 24) | (data[i * 3] << 16) |
+                     (data[i * 3 + 1] << 8) | data[i * 3 + 2];
+    }
+    data += 256 * 3;
+
+    int i = 0;
+    while (i < pixelCount) {
+        if (end - data < 2) {
+            return false;
+        }
+        int control = *data++;
+        if (control < 128) {
+            int count = std::min(control + 1, pixelCount - i);
+            if (end - data < count) {
+                return false;
+            }
+            for (int j = 0; j < count; j++) {
+                pixels[i++] = palette[*data++];
+            }
+        } else {
+            unsigned int color = palette[*data++];
+            int count = std::min(control - 126, pixelCount - i);
+            for (int j = 0; j < count; j++) {
+                pixels[i++] = color;
+            }
+        }
+    }
+    return true;
+}
+
+// Appends frames to a temporary file that replaces the cache once the last
+// frame is written, so an interrupted bake never leaves a partial cache.
+struct FrameCacheWriter
+{
+    FILE* file = nullptr;
+    std::filesystem::path path;
+    std::filesystem::path temporaryPath;
+    FrameCacheHeader header;
+    std::vector<uint64_t> offsets;
+    std::vector<unsigned char> buffer;
+};
+
+bool
+openFrameCacheWriter(FrameCacheWriter& writer,
+                     const std::filesystem::path& path,
+                     const FrameCacheHeader& header)
+{
+    std::error_code error;
+    std::filesystem::create_directories(path.parent_path(), error);
+
+    writer.path = path;
+    writer.temporaryPath = path;
+    writer.temporaryPath += ".partial";
+    writer.header = header;
+    writer.offsets.clear();
+    writer.file = fopen(writer.temporaryPath.c_str(), "wb");
+    if (!writer.file) {
+        return false;
+    }
+
+    // The offsets are written over the placeholders once all frames are in.
+    std::vector<uint64_t> placeholders(header.frameCount + 1, 0);
+    fwrite(&header, sizeof(header), 1, writer.file);
+    fwrite(placeholders.data(),
+           sizeof(uint64_t),
+           placeholders.size(),
+           writer.file);
+    writer.offsets.push_back(ftell(writer.file));
+    return true;
+}
+
+void
+writeCachedFrame(FrameCacheWriter& writer, const unsigned int* pixels)
+{
+    writer.buffer.clear();
+    encodeFrame(
+      pixels, writer.header.width * writer.header.height, writer.buffer);
+    fwrite(writer.buffer.data(), 1, writer.buffer.size(), writer.file);
+    writer.offsets.push_back(writer.offsets.back() + writer.buffer.size());
+}
+
+bool
+finishFrameCacheWriter(FrameCacheWriter& writer)
+{
+    fseek(writer.file, sizeof(FrameCacheHeader), SEEK_SET);
+    fwrite(writer.offsets.data(),
+           sizeof(uint64_t),
+           writer.offsets.size(),
+           writer.file);
+    bool written = ferror(writer.file) == 0;
+    written = fclose(writer.file) == 0 && written;
+    writer.file = nullptr;
+
+    std::error_code error;
+    if (written) {
+        std::filesystem::rename(writer.temporaryPath, writer.path, error);
+    }
+    if (!written || error) {
+        std::filesystem::remove(writer.temporaryPath, error);
+        return false;
+    }
+    return true;
+}
+
+void
+abortFrameCacheWriter(FrameCacheWriter& writer)
+{
+    if (writer.file) {
+        fclose(writer.file);
+        writer.file = nullptr;
+        std::error_code error;
+        std::filesystem::remove(writer.temporaryPath, error);
+    }
+}
+
+// Memory mapped cache file.
+struct FrameCache
+{
+    void* data = nullptr;
+    size_t size = 0;
+    const FrameCacheHeader* header = nullptr;
+    const uint64_t* offsets = nullptr;
+};
+
+// Maps the cache at `path` if it exists, matches `expected` and its frame
+// offsets are in order and inside of the file.
+bool
+openFrameCache(FrameCache& cache,
+               const std::filesystem::path& path,
+               const FrameCacheHeader& expected)
+{
+    int file = open(path.c_str(), O_RDONLY);
+    if (file < 0) {
+        return false;
+    }
+    struct stat status;
+    if (fstat(file, &status) != 0 ||
+        (size_t)status.st_size < sizeof(FrameCacheHeader)) {
+        close(file);
+        return false;
+    }
+
+    void* data = mmap(nullptr, status.st_size, PROT_READ, MAP_SHARED, file, 0);
+    close(file);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+
+    const FrameCacheHeader* header = (const FrameCacheHeader*)data;
+    const uint64_t* offsets = (const uint64_t*)(header + 1);
+    size_t tableEnd =
+      sizeof(FrameCacheHeader) + (expected.frameCount + 1) * sizeof(uint64_t);
+    bool valid = memcmp(header, &expected, sizeof(FrameCacheHeader)) == 0 &&
+                 (size_t)status.st_size >= tableEnd &&
+                 offsets[0] == tableEnd &&
+                 offsets[expected.frameCount] == (uint64_t)status.st_size;
+    for (uint32_t i = 0; valid && i < expected.frameCount; i++) {
+        valid = offsets[i] < offsets[i + 1];
+    }
+    if (!valid) {
+        munmap(data, status.st_size);
+        return false;
+    }
+
+    cache.data = data;
+    cache.size = status.st_size;
+    cache.header = header;
+    cache.offsets = offsets;
+    return true;
+}
+
+void
+closeFrameCache(FrameCache& cache)
+{
+    if (cache.data) {
+        munmap(cache.data, cache.size);
+    }
+    cache = FrameCache{};
+}
+
+bool
+decodeCachedFrame(const FrameCache& cache, int frame, unsigned int* pixels)
+{
+    const unsigned char* data =
+      (const unsigned char*)cache.data + cache.offsets[frame];
+    return decodeFrame(data,
+                       cache.offsets[frame + 1] - cache.offsets[frame],
+                       cache.header->width * cache.header->height,
+                       pixels);
+}
+
 float quadVertices[] = { -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, -1.0f,
                          -1.0f, 1.0f, 1.0f,  -1.0f, 1.0f, 1.0f };
 
 int
-main()
+main(int argc, char** argv)
 {
+    // With `--live` every frame is ray marched and the loop cache is unused.
+    bool live = argc > 1 && std::string(argv[1]) == "--live";
+
     // X11
 
     Imlib_Image image;
@@ -152,6 +606,47 @@ main()
     float deltaTime = 0.025f;
     float time = distributionTime(randomGenerator);
 
+    // Loop cache
+
+    int frameCount = std::lround(loopPeriod / (deltaTime * cacheStride));
+    int cacheWidth = screenWidth / cacheScale;
+    int cacheHeight = screenHeight / cacheScale;
+
+    FrameCacheHeader cacheHeader = {};
+    memcpy(cacheHeader.magic, frameCacheMagic, sizeof(frameCacheMagic));
+    cacheHeader.shaderHash =
+      hashString(fragmentShaderSource, hashString(vertexShaderSource));
+    cacheHeader.width = cacheWidth;
+    cacheHeader.height = cacheHeight;
+    cacheHeader.period = loopPeriod;
+    cacheHeader.frameCount = frameCount;
+
+    std::filesystem::path cachePath =
+      frameCachePath(cacheHeader.shaderHash, cacheWidth, cacheHeight);
+
+    FrameCache cache;
+    FrameCacheWriter cacheWriter;
+    bool playing = !live && openFrameCache(cache, cachePath, cacheHeader);
+    bool baking = !live && !playing &&
+                  openFrameCacheWriter(cacheWriter, cachePath, cacheHeader);
+
+    // The bake renders the period from its start and caches every
+    // `cacheStride`-th of its `bakeStep`s, playback starts anywhere.
+    int frame = 0;
+    int bakeStep = 0;
+    if (playing) {
+        frame = std::uniform_int_distribution<int>(0, frameCount - 1)(
+          randomGenerator);
+    }
+    if (baking) {
+        std::cout << "Rendering the loop cache to " << cachePath << std::endl;
+    }
+
+    unsigned int* cacheData =
+      (unsigned int*)malloc(cacheWidth * cacheHeight * sizeof(unsigned int));
+
+    auto nextFrameTime = std::chrono::steady_clock::now();
+
     GLubyte* pixels =
       new GLubyte[3 * screenWidth * screenHeight]; // 3 channels (RGB)
     unsigned int* ARGBData =
@@ -176,49 +671,114 @@ main()
 
     while (!glfwWindowShouldClose(window)) {
 
-        // Clear the screen
+        // A cache that does not decode is baked again.
+        if (playing && !decodeCachedFrame(cache, frame, cacheData)) {
+            std::cerr << "Invalid loop cache " << cachePath << std::endl;
+            closeFrameCache(cache);
+            playing = false;
+            baking = openFrameCacheWriter(cacheWriter, cachePath, cacheHeader);
+            frame = 0;
+            bakeStep = 0;
+        }
 
-        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
+        if (playing) {
 
-        GLint screenSizeLocation =
-          glGetUniformLocation(shaderProgram, "screenSize");
-        glUseProgram(shaderProgram);
-        glUniform2f(
-          screenSizeLocation, (float)screenWidth, (float)screenHeight);
+            frame = (frame + 1) % frameCount;
 
-        GLint timeLocation = glGetUniformLocation(shaderProgram, "time");
-        glUseProgram(shaderProgram);
-        glUniform1f(timeLocation, time);
+            image =
+              imlib_create_image_using_data(cacheWidth, cacheHeight, cacheData);
 
-        // Render the screen
+            nextFrameTime +=
+              std::chrono::microseconds(1000000 / cacheFramesPerSecond);
+            std::this_thread::sleep_until(nextFrameTime);
 
-        glUseProgram(shaderProgram);
-        glBindVertexArray(quadVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+        } else {
 
-        // Wallpaper
+            if (baking) {
+                time = bakeStep * loopPeriod / (frameCount * cacheStride);
+            }
 
-        glReadPixels(
-          0, 0, screenWidth, screenHeight, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+            // Clear the screen
+
+            glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+
+            GLint screenSizeLocation =
+              glGetUniformLocation(shaderProgram, "screenSize");
+            glUseProgram(shaderProgram);
+            glUniform2f(
+              screenSizeLocation, (float)screenWidth, (float)screenHeight);
+
+            GLint timeLocation = glGetUniformLocation(shaderProgram, "time");
+            glUseProgram(shaderProgram);
+            glUniform1f(timeLocation, time);
+
+            // Render the screen. The 3D app's compute marcher is left out:
+            // past the first run frames come from the loop cache without the
+            // GPU, and the context stays at OpenGL 3.3.
+
+            glUseProgram(shaderProgram);
+            glBindVertexArray(quadVAO);
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+
+            // Wallpaper
+
+            glReadPixels(0,
+                         0,
+                         screenWidth,
+                         screenHeight,
+                         GL_RGB,
+                         GL_UNSIGNED_BYTE,
+                         pixels);
+
+            for (int y = 0; y < screenHeight; y++) {
+                for (int x = 0; x < screenWidth; x++) {
+                    // Index in the RGB array
+                    int i = (y * screenWidth + x) * 3;
+                    int index = ((screenHeight - 1 - y) * screenWidth +
+                                 x); // Flipping the image vertically
+                    ARGBData[index] = (0xFF << 24) | (pixels[i] << 16) |
+                                      (pixels[i + 1] << 8) | pixels[i + 2];
+                }
+            }
 
-        for (int y = 0; y < screenHeight; y++) {
-            for (int x = 0; x < screenWidth; x++) {
-                int i = (y * screenWidth + x) * 3; // Index in the RGB array
-                int index = ((screenHeight - 1 - y) * screenWidth +
-                             x); // Flipping the image vertically
-                ARGBData[index] = (0xFF << 24) | (pixels[i] << 16) |
-                                  (pixels[i + 1] << 8) | pixels[i + 2];
+            if (baking) {
+                if (bakeStep % cacheStride == 0) {
+                    downscale(ARGBData,
+                              screenWidth,
+                              screenHeight,
+                              cacheScale,
+                              cacheData);
+                    writeCachedFrame(cacheWriter, cacheData);
+                }
+                bakeStep++;
+
+                if (bakeStep == frameCount * cacheStride) {
+                    baking = false;
+                    frame = 0;
+                    playing = finishFrameCacheWriter(cacheWriter) &&
+                              openFrameCache(cache, cachePath, cacheHeader);
+                    nextFrameTime = std::chrono::steady_clock::now();
+                }
             }
+
+            // Create an image from the ARGB data
+            image = imlib_create_image_using_data(
+              screenWidth, screenHeight, ARGBData);
+
+            // Time
+
+            time += deltaTime;
         }
 
-        // Create an image from the ARGB data
-        image =
-          imlib_create_image_using_data(screenWidth, screenHeight, ARGBData);
         imlib_context_set_image(image);
+        int imageWidth = imlib_image_get_width();
+        int imageHeight = imlib_image_get_height();
 
         scaledImage = imlib_create_cropped_scaled_image(
-          0, 0, screenWidth, screenHeight, mode->width, mode->height);
+          0, 0, imageWidth, imageHeight, mode->width, mode->height);
+        // The image only wraps the pixels, which stay allocated.
+        imlib_free_image();
         imlib_context_set_image(scaledImage);
 
         imlib_context_set_display(display);
@@ -260,10 +820,6 @@ main()
 
         imlib_free_image();
 
-        // Time
-
-        time += deltaTime;
-
         // Swap buffers and poll events
 
         glfwSwapBuffers(window);
@@ -277,6 +833,10 @@ main()
 
     free(pixels);
     free(ARGBData);
+    free(cacheData);
+
+    abortFrameCacheWriter(cacheWriter);
+    closeFrameCache(cache);
 
     glDeleteProgram(shaderProgram);
     glfwTerminate();
@@ -0,0 +1,768 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <distance_estimators/distance_estimators.h>
+#include <eigen3/Eigen/Dense>
+
+// Lattice of `resolution` leaf cells per axis over the bounds of the fractal.
+// The surface is the level set `DE = iso`: several estimators are unsigned, so
+// the mesh wraps the fractal at half a leaf cell.
+struct Grid
+{
+    DistanceEstimators::Fractal fractal;
+    float time = 0.0f;
+    Eigen::Vector3f origin;
+    float leafSize = 0.0f;
+    float iso = 0.0f;
+    int resolution = 0;
+    int brickSize = 0;
+};
+
+// Estimators are not finite at the singular points of their iterations, like
+// the origin of the Mandelbulb, which are inside.
+float
+field(const Grid& grid, const Eigen::Vector3f& position)
+{
+    float distance =
+      DistanceEstimators::estimate(grid.fractal, position, grid.time);
+    return std::isfinite(distance) ? distance - grid.iso : -grid.iso;
+}
+
+Eigen::Vector3f
+latticePosition(const Grid& grid, const Eigen::Vector3i& point)
+{
+    return grid.origin + point.cast<float>() * grid.leafSize;
+}
+
+// Lattice coordinates, offset by one so that the cells just outside of the
+// grid still have a key.
+uint64_t
+latticeKey(const Eigen::Vector3i& point)
+{
+    return (uint64_t)(point.x() + 1) << 42 | (uint64_t)(point.y() + 1) << 21 |
+           (uint64_t)(point.z() + 1);
+}
+
+// Lattice points and edges on the seams between bricks, which neighbouring
+// bricks would otherwise evaluate and emit twice. A point is on a seam when
+// one of its coordinates is within one of a multiple of `Grid::brickSize`,
+// the reach of the normal stencils across a brick face.
+bool
+onSeam(const Grid& grid, const Eigen::Vector3i& point)
+{
+    for (int axis = 0; axis < 3; axis++) {
+        int offset = (point[axis] % grid.brickSize + grid.brickSize) %
+                     grid.brickSize;
+        if (offset <= 1 || offset == grid.brickSize - 1) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// The edge from `point` along `axis` lies on a brick face.
+bool
+edgeOnSeam(const Grid& grid, const Eigen::Vector3i& point, int axis)
+{
+    for (int other = 0; other < 3; other++) {
+        if (other != axis && point[other] % grid.brickSize == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Seam values shared by the bricks, kept per slab of bricks along z. A brick
+// reaches one lattice point into the slabs around its own, so a slab is
+// dropped once it and both of its neighbours are written.
+struct SeamSlab
+{
+    static const int shardCount = 16;
+    std::mutex mutexes[shardCount];
+    std::unordered_map<uint64_t, float> corners[shardCount];
+    // Global index of the vertex written for a seam edge, only used under the
+    // lock of the mesh writer.
+    std::unordered_map<uint64_t, uint64_t> vertices[3];
+};
+
+struct Seams
+{
+    std::vector<SeamSlab> slabs;
+    std::vector<int> writtenBricks; // Per slab, under the writer lock
+    int bricksPerSlab = 0;
+};
+
+SeamSlab&
+seamSlab(const Grid& grid, Seams& seams, const Eigen::Vector3i& point)
+{
+    int slab = std::clamp(
+      point.z() / grid.brickSize, 0, (int)seams.slabs.size() - 1);
+    return seams.slabs[slab];
+}
+
+// Part of the octree below a cell of `Grid::brickSize` leaves, processed by one
+// worker. Only the brick being processed is kept in memory.
+struct Brick
+{
+    Eigen::Vector3i minimum;
+    std::vector<Eigen::Vector3i> surfaceCells;
+    std::unordered_map<uint64_t, float> corners;
+    std::unordered_map<uint64_t, uint32_t> edgeVertices[3];
+    std::vector<Eigen::Vector3f> vertices;
+    std::vector<Eigen::Vector3f> normals; // Of the edge vertices
+    // Lattice edge of every vertex, with axis -1 for the vertices inside cells.
+    std::vector<std::pair<int, Eigen::Vector3i>> vertexEdges;
+    std::vector<std::array<uint32_t, 3>> triangles;
+    uint64_t evaluations = 0;
+};
+
+float
+corner(const Grid& grid,
+       Seams& seams,
+       Brick& brick,
+       const Eigen::Vector3i& point)
+{
+    uint64_t key = latticeKey(point);
+    auto [iterator, inserted] = brick.corners.try_emplace(key);
+    if (!inserted) {
+        return iterator->second;
+    }
+
+    // The boundary of the lattice is outside, which closes the mesh of the
+    // fractals that fill their bounds.
+    if ((point.array() <= 0).any() ||
+        (point.array() >= grid.resolution).any()) {
+        iterator->second = grid.iso;
+        return iterator->second;
+    }
+
+    if (!onSeam(grid, point)) {
+        iterator->second = field(grid, latticePosition(grid, point));
+        brick.evaluations++;
+        return iterator->second;
+    }
+
+    // Another worker may evaluate the same point meanwhile, both get the same
+    // value.
+    SeamSlab& slab = seamSlab(grid, seams, point);
+    int shard = key % SeamSlab::shardCount;
+    {
+        std::lock_guard<std::mutex> lock(slab.mutexes[shard]);
+        auto found = slab.corners[shard].find(key);
+        if (found != slab.corners[shard].end()) {
+            iterator->second = found->second;
+            return iterator->second;
+        }
+    }
+    float value = field(grid, latticePosition(grid, point));
+    brick.evaluations++;
+    {
+        std::lock_guard<std::mutex> lock(slab.mutexes[shard]);
+        slab.corners[shard].emplace(key, value);
+    }
+    iterator->second = value;
+    return value;
+}
+
+// Collects the leaves below the cell at `minimum` that may contain the
+// surface. A cell is skipped when the distance at its center, a lattice point
+// shared with the corners of its leaves, is larger than its half diagonal,
+// with some margin since the estimators overshoot the true distance in places.
+// Leaves are kept as they are, their corners tell whether they are crossed.
+void
+refine(const Grid& grid,
+       Seams& seams,
+       Brick& brick,
+       const Eigen::Vector3i& minimum,
+       int size)
+{
+    if (size == 1) {
+        brick.surfaceCells.push_back(minimum);
+        return;
+    }
+
+    int half = size / 2;
+    float distance =
+      corner(grid, seams, brick, minimum + Eigen::Vector3i::Constant(half));
+    float halfDiagonal = size * grid.leafSize * std::sqrt(3.0f) * 0.5f;
+    if (std::abs(distance) > halfDiagonal * 1.5f) {
+        return;
+    }
+
+    for (int i = 0; i < 8; i++) {
+        Eigen::Vector3i offset(
+          (i & 1) * half, (i >> 1 & 1) * half, (i >> 2) * half);
+        refine(grid, seams, brick, minimum + offset, half);
+    }
+}
+
+// Gradient of the field at a lattice point from central differences of its
+// neighbours, which are mostly corners of surface cells already.
+Eigen::Vector3f
+latticeGradient(const Grid& grid,
+                Seams& seams,
+                Brick& brick,
+                const Eigen::Vector3i& point)
+{
+    Eigen::Vector3f gradient;
+    for (int axis = 0; axis < 3; axis++) {
+        Eigen::Vector3i step = Eigen::Vector3i::Unit(axis);
+        gradient[axis] = corner(grid, seams, brick, point + step) -
+                         corner(grid, seams, brick, point - step);
+    }
+    return gradient;
+}
+
+// Vertex where the surface crosses the lattice edge from `point` along `axis`,
+// shared by the four cells around the edge. Its normal interpolates the
+// lattice gradients at the ends of the edge, so that neighbouring bricks find
+// the same one.
+uint32_t
+edgeVertex(const Grid& grid,
+           Seams& seams,
+           Brick& brick,
+           const Eigen::Vector3i& point,
+           int axis)
+{
+    auto [iterator, inserted] =
+      brick.edgeVertices[axis].try_emplace(latticeKey(point));
+    if (!inserted) {
+        return iterator->second;
+    }
+
+    Eigen::Vector3i next = point + Eigen::Vector3i::Unit(axis);
+    float from = corner(grid, seams, brick, point);
+    float to = corner(grid, seams, brick, next);
+    // Keep off the corners, so that vertices of different edges never share
+    // a position.
+    float t = std::clamp(from / (from - to), 0.001f, 0.999f);
+
+    Eigen::Vector3f normal =
+      (1 - t) * latticeGradient(grid, seams, brick, point) +
+      t * latticeGradient(grid, seams, brick, next);
+    normal.normalize();
+    if (!normal.allFinite()) {
+        normal = Eigen::Vector3f::Unit(axis) * (from < 0 ? 1.0f : -1.0f);
+    }
+
+    iterator->second = brick.vertices.size();
+    brick.vertices.push_back(latticePosition(grid, point) +
+                             Eigen::Vector3f::Unit(axis) * t * grid.leafSize);
+    brick.normals.push_back(normal);
+    brick.vertexEdges.emplace_back(axis, point);
+    return iterator->second;
+}
+
+// The six faces of a cell, as the corners in counter-clockwise order around
+// the outward normal (bit i of a corner is its offset along axis i).
+const int cellFaces[6][4] = {
+    { 0, 4, 6, 2 }, { 1, 3, 7, 5 }, { 0, 1, 5, 4 },
+    { 2, 6, 7, 3 }, { 0, 2, 3, 1 }, { 4, 5, 7, 6 },
+};
+
+// Index of the cell edge between two corners, from the lower corner along
+// the axis in which they differ.
+int
+cellEdge(int a, int b)
+{
+    int axis = (a ^ b) == 1 ? 0 : (a ^ b) == 2 ? 1 : 2;
+    return axis * 8 + std::min(a, b);
+}
+
+// Triangulates the surface in a leaf cell, returns whether any edge of the
+// cell is crossed. On every face the crossings are joined by segments that
+// keep the inside (negative) corners on their left; a face with two opposite
+// inside corners joins them when the mean of its corners is inside. Both
+// cells around a face see the same values, so they agree on its segments and
+// the mesh is closed and manifold. Segments form cycles around the cell, each
+// fanned around a dual contouring vertex that minimizes the squared distances
+// to the tangent planes of its crossings, pulled toward their mean so that
+// flat regions stay well conditioned.
+bool
+polygonizeCell(const Grid& grid,
+               Seams& seams,
+               Brick& brick,
+               const Eigen::Vector3i& cell,
+               bool crossedFaces[6])
+{
+    float values[8];
+    int inside = 0;
+    for (int i = 0; i < 8; i++) {
+        Eigen::Vector3i offset(i & 1, i >> 1 & 1, i >> 2);
+        values[i] = corner(grid, seams, brick, cell + offset);
+        inside += values[i] < 0;
+    }
+    if (inside == 0 || inside == 8) {
+        return false;
+    }
+
+    // Cycle successor of every crossed edge.
+    int next[24];
+    std::fill(next, next + 24, -1);
+
+    for (int face = 0; face < 6; face++) {
+        const int* corners = cellFaces[face];
+        int crossings[4];
+        bool leaving[4];
+        int count = 0;
+        float sum = 0;
+        for (int k = 0; k < 4; k++) {
+            int a = corners[k];
+            int b = corners[(k + 1) % 4];
+            sum += values[a];
+            if ((values[a] < 0) != (values[b] < 0)) {
+                crossings[count] = cellEdge(a, b);
+                leaving[count] = values[a] < 0;
+                count++;
+            }
+        }
+        crossedFaces[face] = count > 0;
+
+        for (int j = 0; j < count; j++) {
+            if (!leaving[j]) {
+                continue;
+            }
+            // Two crossings make a single segment. With four, separate inside
+            // corners pair a crossing with the one before it, joined ones
+            // with the one after it.
+            bool joined = count == 4 && sum < 0;
+            int pair = count == 2 || joined ? (j + 1) % count
+                                            : (j + count - 1) % count;
+            next[crossings[j]] = crossings[pair];
+        }
+    }
+
+    Eigen::Vector3f minimum = latticePosition(grid, cell);
+    Eigen::Vector3f maximum =
+      minimum + Eigen::Vector3f::Constant(grid.leafSize);
+
+    bool visited[24] = {};
+    for (int start = 0; start < 24; start++) {
+        if (next[start] < 0 || visited[start]) {
+            continue;
+        }
+
+        std::vector<uint32_t> cycle;
+        Eigen::Matrix3f a = Eigen::Matrix3f::Zero();
+        Eigen::Vector3f b = Eigen::Vector3f::Zero();
+        Eigen::Vector3f massPoint = Eigen::Vector3f::Zero();
+        for (int edge = start; !visited[edge]; edge = next[edge]) {
+            visited[edge] = true;
+            int axis = edge / 8;
+            int from = edge % 8;
+            uint32_t index = edgeVertex(
+              grid,
+              seams,
+              brick,
+              cell + Eigen::Vector3i(from & 1, from >> 1 & 1, from >> 2),
+              axis);
+            cycle.push_back(index);
+
+            const Eigen::Vector3f& point = brick.vertices[index];
+            const Eigen::Vector3f& normal = brick.normals[index];
+            a += normal * normal.transpose();
+            b += normal * normal.dot(point);
+            massPoint += point;
+        }
+
+        massPoint /= cycle.size();
+        const float regularization = 0.05f;
+        Eigen::Vector3f vertex =
+          (a + regularization * Eigen::Matrix3f::Identity())
+            .ldlt()
+            .solve(b + regularization * massPoint);
+        // Vertices that leave the cell fold the mesh, the mean is safe.
+        if (!vertex.allFinite() ||
+            (vertex.array() < minimum.array()).any() ||
+            (vertex.array() > maximum.array()).any()) {
+            vertex = massPoint;
+        }
+
+        uint32_t center = brick.vertices.size();
+        brick.vertices.push_back(vertex);
+        brick.normals.push_back(Eigen::Vector3f::Zero());
+        brick.vertexEdges.emplace_back(-1, cell);
+
+        // The cycles turn clockwise around the outward normal.
+        for (size_t i = 0; i < cycle.size(); i++) {
+            brick.triangles.push_back(
+              { center, cycle[(i + 1) % cycle.size()], cycle[i] });
+        }
+    }
+
+    return true;
+}
+
+// Triangulates the surface cells of the brick. Crossed cells whose neighbors
+// were skipped by `refine` are added as well, which closes the holes left
+// where an estimator overshoots by more than the margin.
+void
+contour(const Grid& grid, Seams& seams, Brick& brick)
+{
+    std::unordered_set<uint64_t> queued;
+    for (const Eigen::Vector3i& cell : brick.surfaceCells) {
+        queued.insert(latticeKey(cell));
+    }
+
+    Eigen::Vector3i maximum =
+      brick.minimum + Eigen::Vector3i::Constant(grid.brickSize);
+    std::vector<Eigen::Vector3i> cells = std::move(brick.surfaceCells);
+    brick.surfaceCells.clear();
+    while (!cells.empty()) {
+        Eigen::Vector3i cell = cells.back();
+        cells.pop_back();
+
+        bool crossedFaces[6];
+        if (!polygonizeCell(grid, seams, brick, cell, crossedFaces)) {
+            continue;
+        }
+
+        for (int face = 0; face < 6; face++) {
+            Eigen::Vector3i neighbor = cell;
+            neighbor[face / 2] += face % 2 ? 1 : -1;
+            if (!crossedFaces[face] ||
+                (neighbor.array() < brick.minimum.array()).any() ||
+                (neighbor.array() >= maximum.array()).any()) {
+                continue;
+            }
+            if (queued.insert(latticeKey(neighbor)).second) {
+                cells.push_back(neighbor);
+            }
+        }
+    }
+}
+
+// Streams bricks into a binary little-endian PLY or an OBJ file. PLY stores
+// all vertices before the faces and has their counts in the header, so faces
+// go to a temporary file that is appended at the end and the counts are
+// written over zero-padded placeholders.
+struct MeshWriter
+{
+    FILE* file = nullptr;
+    FILE* faces = nullptr;
+    bool ply = false;
+    long vertexCountOffset = 0;
+    long faceCountOffset = 0;
+    uint64_t vertexCount = 0;
+    uint64_t faceCount = 0;
+    std::mutex mutex;
+    // Uses of every directed edge of the triangles, when checking the mesh.
+    bool check = false;
+    std::unordered_map<uint64_t, int> directedEdges;
+};
+
+bool
+openMeshWriter(MeshWriter& writer,
+               const std::string& filePath,
+               const char* comment)
+{
+    writer.ply = filePath.size() >= 4 &&
+                 filePath.compare(filePath.size() - 4, 4, ".ply") == 0;
+    writer.file = fopen(filePath.c_str(), "wb");
+    if (!writer.file) {
+        return false;
+    }
+
+    if (!writer.ply) {
+        fprintf(writer.file, "# %s\n", comment);
+        return true;
+    }
+
+    writer.faces = tmpfile();
+    if (!writer.faces) {
+        fclose(writer.file);
+        return false;
+    }
+
+    fprintf(writer.file,
+            "ply\nformat binary_little_endian 1.0\ncomment %s\n",
+            comment);
+    fprintf(writer.file, "element vertex ");
+    writer.vertexCountOffset = ftell(writer.file);
+    fprintf(writer.file,
+            "%020llu\nproperty float x\nproperty float y\nproperty float z\n",
+            0ull);
+    fprintf(writer.file, "element face ");
+    writer.faceCountOffset = ftell(writer.file);
+    fprintf(writer.file,
+            "%020llu\nproperty list uchar int vertex_indices\nend_header\n",
+            0ull);
+    return true;
+}
+
+// Writes the vertices of the brick that are not on a seam already written by
+// a neighbouring brick, then the triangles with their global indices.
+void
+writeBrick(MeshWriter& writer,
+           const Grid& grid,
+           Seams& seams,
+           const Brick& brick)
+{
+    std::lock_guard<std::mutex> lock(writer.mutex);
+
+    std::vector<uint64_t> indices(brick.vertices.size());
+    for (size_t i = 0; i < brick.vertices.size(); i++) {
+        auto [axis, point] = brick.vertexEdges[i];
+        if (axis >= 0 && edgeOnSeam(grid, point, axis)) {
+            auto [iterator, inserted] =
+              seamSlab(grid, seams, point)
+                .vertices[axis]
+                .try_emplace(latticeKey(point), writer.vertexCount);
+            if (!inserted) {
+                indices[i] = iterator->second;
+                continue;
+            }
+        }
+
+        const Eigen::Vector3f& vertex = brick.vertices[i];
+        if (writer.ply) {
+            fwrite(vertex.data(), sizeof(float), 3, writer.file);
+        } else {
+            fprintf(writer.file,
+                    "v %.7g %.7g %.7g\n",
+                    vertex.x(),
+                    vertex.y(),
+                    vertex.z());
+        }
+        indices[i] = writer.vertexCount++;
+    }
+
+    for (const std::array<uint32_t, 3>& triangle : brick.triangles) {
+        uint64_t global[3];
+        for (int i = 0; i < 3; i++) {
+            global[i] = indices[triangle[i]];
+        }
+        if (writer.ply) {
+            unsigned char count = 3;
+            int32_t values[3] = { (int32_t)global[0],
+                                  (int32_t)global[1],
+                                  (int32_t)global[2] };
+            fwrite(&count, 1, 1, writer.faces);
+            fwrite(values, sizeof(values), 1, writer.faces);
+        } else {
+            fprintf(writer.file,
+                    "f %llu %llu %llu\n",
+                    (unsigned long long)(global[0] + 1),
+                    (unsigned long long)(global[1] + 1),
+                    (unsigned long long)(global[2] + 1));
+        }
+        if (writer.check) {
+            for (int i = 0; i < 3; i++) {
+                writer.directedEdges[global[i] << 32 | global[(i + 1) % 3]]++;
+            }
+        }
+    }
+    writer.faceCount += brick.triangles.size();
+
+    // Drop the seams of the slabs that no brick reaches anymore.
+    int slab = brick.minimum.z() / grid.brickSize;
+    seams.writtenBricks[slab]++;
+    for (int i = std::max(slab - 1, 0);
+         i <= std::min(slab + 1, (int)seams.slabs.size() - 1);
+         i++) {
+        bool done = true;
+        for (int j = std::max(i - 1, 0);
+             j <= std::min(i + 1, (int)seams.slabs.size() - 1);
+             j++) {
+            done = done && seams.writtenBricks[j] == seams.bricksPerSlab;
+        }
+        if (done) {
+            for (auto& corners : seams.slabs[i].corners) {
+                corners = {};
+            }
+            for (auto& vertices : seams.slabs[i].vertices) {
+                vertices = {};
+            }
+        }
+    }
+}
+
+// Counts the directed edges of the mesh that are not used exactly once, with
+// their opposite used exactly once: zero for a closed, consistently oriented
+// manifold.
+uint64_t
+badEdgeCount(const MeshWriter& writer)
+{
+    uint64_t count = 0;
+    for (const auto& [edge, uses] : writer.directedEdges) {
+        auto opposite = writer.directedEdges.find(edge << 32 | edge >> 32);
+        if (uses != 1 || opposite == writer.directedEdges.end() ||
+            opposite->second != 1) {
+            count++;
+        }
+    }
+    return count;
+}
+
+bool
+closeMeshWriter(MeshWriter& writer)
+{
+    if (writer.ply) {
+        rewind(writer.faces);
+        char buffer[1 << 16];
+        size_t read;
+        while ((read = fread(buffer, 1, sizeof(buffer), writer.faces)) > 0) {
+            fwrite(buffer, 1, read, writer.file);
+        }
+        fclose(writer.faces);
+
+        fseek(writer.file, writer.vertexCountOffset, SEEK_SET);
+        fprintf(writer.file, "%020llu", (unsigned long long)writer.vertexCount);
+        fseek(writer.file, writer.faceCountOffset, SEEK_SET);
+        fprintf(writer.file, "%020llu", (unsigned long long)writer.faceCount);
+    }
+
+    bool written = ferror(writer.file) == 0;
+    return fclose(writer.file) == 0 && written;
+}
+
+void
+printUsage()
+{
+    std::cerr << "Usage: mesh_extractor [--check] <fractal> <depth> "
+                 "<output.ply|obj> [time] [threads]\n"
+                 "Fractals: mandelbulb, menger, julia, apollonian, mandelbox\n"
+                 "The grid has 2^depth cells per axis. --check counts the "
+                 "edges that are open or not manifold, for small meshes."
+              << std::endl;
+}
+
+int
+main(int argc, char** argv)
+{
+    bool check = argc > 1 && strcmp(argv[1], "--check") == 0;
+    if (check) {
+        argc--;
+        argv++;
+    }
+    if (argc < 4) {
+        printUsage();
+        return -1;
+    }
+
+    const char* fractalNames[] = {
+        "mandelbulb", "menger", "julia", "apollonian", "mandelbox"
+    };
+    int fractal = -1;
+    for (int i = 0; i < 5; i++) {
+        if (strcmp(argv[1], fractalNames[i]) == 0) {
+            fractal = i;
+        }
+    }
+    int depth = atoi(argv[2]);
+    if (fractal < 0 || depth < 1 || depth > 20) {
+        printUsage();
+        return -1;
+    }
+
+    Grid grid;
+    grid.fractal = (DistanceEstimators::Fractal)fractal;
+    grid.time = argc > 4 ? atof(argv[4]) : 0.0f;
+    float bounds = DistanceEstimators::bounds(grid.fractal);
+    grid.origin = Eigen::Vector3f::Constant(-bounds);
+    grid.resolution = 1 << depth;
+    grid.leafSize = 2 * bounds / grid.resolution;
+    grid.iso = grid.leafSize * 0.5f;
+    grid.brickSize = std::min(grid.resolution, 64);
+
+    int threadCount = argc > 5 ? atoi(argv[5]) : 0;
+    if (threadCount <= 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    MeshWriter writer;
+    std::string comment = std::string(DistanceEstimators::name(grid.fractal)) +
+                          ", " + std::to_string(grid.resolution) +
+                          "^3 cells, time " + std::to_string(grid.time);
+    if (!openMeshWriter(writer, argv[3], comment.c_str())) {
+        std::cerr << "Could not open " << argv[3] << std::endl;
+        return -1;
+    }
+    writer.check = check;
+
+    // Workers take bricks in order until none are left, so that the seams of
+    // only a few slabs are kept at once.
+
+    int bricksPerAxis = grid.resolution / grid.brickSize;
+    int brickCount = bricksPerAxis * bricksPerAxis * bricksPerAxis;
+    Seams seams;
+    seams.slabs = std::vector<SeamSlab>(bricksPerAxis);
+    seams.writtenBricks.assign(bricksPerAxis, 0);
+    seams.bricksPerSlab = bricksPerAxis * bricksPerAxis;
+    std::atomic<int> nextBrick{ 0 };
+    std::atomic<uint64_t> evaluations{ 0 };
+
+    auto start = std::chrono::steady_clock::now();
+
+    auto work = [&]() {
+        Brick brick;
+        for (int i = nextBrick++; i < brickCount; i = nextBrick++) {
+            brick.minimum = Eigen::Vector3i(i % bricksPerAxis,
+                                            i / bricksPerAxis % bricksPerAxis,
+                                            i / bricksPerAxis / bricksPerAxis) *
+                            grid.brickSize;
+            brick.surfaceCells.clear();
+            brick.corners.clear();
+            for (auto& vertices : brick.edgeVertices) {
+                vertices.clear();
+            }
+            brick.vertices.clear();
+            brick.normals.clear();
+            brick.vertexEdges.clear();
+            brick.triangles.clear();
+            brick.evaluations = 0;
+
+            refine(grid, seams, brick, brick.minimum, grid.brickSize);
+            contour(grid, seams, brick);
+            writeBrick(writer, grid, seams, brick);
+
+            evaluations += brick.evaluations;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < threadCount; i++) {
+        threads.emplace_back(work);
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+
+    uint64_t vertexCount = writer.vertexCount;
+    uint64_t faceCount = writer.faceCount;
+    uint64_t badEdges = badEdgeCount(writer);
+    if (!closeMeshWriter(writer)) {
+        std::cerr << "Could not write " << argv[3] << std::endl;
+        return -1;
+    }
+
+    double denseEvaluations = std::pow((double)grid.resolution + 1, 3);
+    std::cout << comment << ": " << vertexCount << " vertices, " << faceCount
+              << " triangles in " << seconds << " s on " << threadCount
+              << " threads, " << evaluations << " evaluations ("
+              << 100.0 * evaluations / denseEvaluations << "% of a dense grid)"
+              << std::endl;
+    if (check) {
+        std::cout << badEdges << " open or non-manifold directed edges"
+                  << std::endl;
+    }
+
+    return badEdges == 0 ? 0 : 1;
+}
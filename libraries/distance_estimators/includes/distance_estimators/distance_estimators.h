@@ -0,0 +1,46 @@
+#pragma once
+
+#include <Eigen/Dense>
+
+// C++ ports of the estimators in
+// `applications/3d_fractals/sources/distance_estimators.glsl`, `time` is the
+// shader uniform of the same name.
+namespace DistanceEstimators {
+
+enum Fractal
+{
+    Mandelbulb,
+    MengerSponge,
+    Julia,
+    Apollonian,
+    Mandelbox,
+};
+
+float
+mandelbulb(const Eigen::Vector3f& position, float time);
+
+float
+mengerSponge(const Eigen::Vector3f& position);
+
+float
+julia(const Eigen::Vector3f& position, float time);
+
+float
+apollonian(const Eigen::Vector3f& position);
+
+float
+mandelbox(const Eigen::Vector3f& position, float time);
+
+float
+estimate(Fractal fractal, const Eigen::Vector3f& position, float time);
+
+// Half size of a cube centered at the origin that contains the fractal, the
+// same regions as `intersectBounds` in the shader. The Apollonian gasket fills
+// space, its cube is one period.
+float
+bounds(Fractal fractal);
+
+const char*
+name(Fractal fractal);
+
+}
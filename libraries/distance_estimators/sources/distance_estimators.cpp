@@ -0,0 +1,232 @@
+#include "distance_estimators.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace DistanceEstimators {
+
+namespace {
+
+// GLSL `mod`, the result has the sign of `y`.
+float
+mod(float x, float y)
+{
+    return x - y * std::floor(x / y);
+}
+
+Eigen::Vector4f
+quaternionMultiplication(const Eigen::Vector4f& a, const Eigen::Vector4f& b)
+{
+    return Eigen::Vector4f(a.x() * b.x() - a.y() * b.y() - a.z() * b.z() -
+                             a.w() * b.w(),
+                           a.x() * b.y() + a.y() * b.x() + a.z() * b.w() -
+                             a.w() * b.z(),
+                           a.x() * b.z() - a.y() * b.w() + a.z() * b.x() +
+                             a.w() * b.y(),
+                           a.x() * b.w() + a.y() * b.z() - a.z() * b.y() +
+                             a.w() * b.x());
+}
+
+}
+
+float
+mandelbulb(const Eigen::Vector3f& position, float time)
+{
+    Eigen::Vector3f z = position;
+    float dr = 1.0f;
+    float r = 0.0f;
+
+    float amplitude = 3.0f;
+    float power = 3.0f + std::sin(time / amplitude) * amplitude + amplitude;
+
+    float bailout = 4.0f;
+    int iterations = 5;
+
+    for (int i = 0; i < iterations; i++) {
+        r = z.norm();
+
+        if (r > bailout)
+            break;
+
+        // Convert to polar coordinates.
+        float theta = std::asin(z.z() / r);
+        float phi = std::atan2(z.y(), z.x());
+        dr = std::pow(r, power - 1.0f) * power * dr + 1.0f;
+
+        // Scale and rotate the point.
+        float zr = std::pow(r, power);
+        theta = theta * power;
+        phi = phi * power;
+
+        // Convert back to cartesian coordinates.
+        z = zr * Eigen::Vector3f(std::cos(theta) * std::cos(phi),
+                                 std::cos(theta) * std::sin(phi),
+                                 std::sin(theta));
+        z += position;
+    }
+
+    return 0.5f * std::log(r) * r / dr;
+}
+
+float
+mengerSponge(const Eigen::Vector3f& position)
+{
+    // Center the position and scale it
+    Eigen::Vector3f p = position * 0.5f + Eigen::Vector3f::Constant(0.5f);
+
+    // Distance to the initial box
+    Eigen::Vector3f box =
+      (p - Eigen::Vector3f::Constant(0.5f)).cwiseAbs() -
+      Eigen::Vector3f::Constant(0.5f);
+    float d = box.maxCoeff();
+
+    float scale = 1.0f;
+    int n = 10;
+
+    for (int i = 1; i <= n; ++i) {
+        float xa = mod(3.0f * p.x() * scale, 3.0f);
+        float ya = mod(3.0f * p.y() * scale, 3.0f);
+        float za = mod(3.0f * p.z() * scale, 3.0f);
+        scale *= 3.0f;
+
+        // Distance inside the 3 axis-aligned square tubes
+        float xx = 0.5f - std::abs(xa - 1.5f);
+        float yy = 0.5f - std::abs(ya - 1.5f);
+        float zz = 0.5f - std::abs(za - 1.5f);
+        float d1 = std::min(std::max(xx, zz),
+                            std::min(std::max(xx, yy), std::max(yy, zz))) /
+                   scale;
+
+        // Intersection with the previous distance
+        d = std::max(d, d1);
+    }
+
+    return d;
+}
+
+float
+julia(const Eigen::Vector3f& position, float time)
+{
+    const int maxIterations = 32;
+    const float bailout = 2.0f;
+
+    Eigen::Vector4f c(-0.8f + 0.2f * std::sin(time * 4), 0.156f, 0.0f, 0.0f);
+
+    Eigen::Vector4f z(position.x(), position.y(), position.z(), 0.0f);
+    Eigen::Vector4f dz(1.0f, 0.0f, 0.0f, 0.0f);
+
+    for (int i = 0; i < maxIterations; ++i) {
+        if (z.norm() > bailout)
+            break;
+
+        dz = 2.0f * quaternionMultiplication(z, dz);
+        z = quaternionMultiplication(z, z) + c;
+    }
+
+    return 0.5f * z.norm() * std::log(z.norm()) / dz.norm();
+}
+
+float
+apollonian(const Eigen::Vector3f& position)
+{
+    Eigen::Vector3f p = position;
+    int iterations = 8;
+    float scale = 1.0f;
+
+    for (int i = 0; i < iterations; i++) {
+        // Wrap into [-1, 1).
+        for (int axis = 0; axis < 3; axis++) {
+            p[axis] = -1.0f + mod(mod(p[axis] + 1.0f, 2.0f) + 2.0f, 2.0f);
+        }
+
+        float d = p.dot(p);
+        float r = 1.333f;
+        float a = r / d;
+
+        scale = a * scale;
+        p = p * a;
+    }
+
+    return std::abs(p.z()) * 0.25f / scale;
+}
+
+float
+mandelbox(const Eigen::Vector3f& position, float time)
+{
+    const float fixedRadius2 = 1.0f;
+    const float minRadius2 = 0.5f;
+    const float foldingLimit = 1.0f;
+
+    float scale = -3.0f + std::sin(time);
+    int iterations = 10;
+    Eigen::Vector3f z = position;
+    float dr = 1.0f;
+
+    for (int n = 0; n < iterations; n++) {
+        // Reflect
+        z = z.cwiseMax(-foldingLimit).cwiseMin(foldingLimit) * 2.0f - z;
+
+        // Sphere inversion
+        float r2 = z.dot(z);
+        if (r2 < minRadius2) {
+            z *= fixedRadius2 / minRadius2;
+            dr *= fixedRadius2 / minRadius2;
+        } else if (r2 < fixedRadius2) {
+            z *= fixedRadius2 / r2;
+            dr *= fixedRadius2 / r2;
+        }
+
+        // Scale and translate
+        z = scale * z + position;
+        dr = dr * std::abs(scale) + 1.0f;
+    }
+
+    return z.norm() / std::abs(dr);
+}
+
+float
+estimate(Fractal fractal, const Eigen::Vector3f& position, float time)
+{
+    switch (fractal) {
+        case Mandelbulb:
+            return mandelbulb(position, time);
+        case MengerSponge:
+            return mengerSponge(position);
+        case Julia:
+            return julia(position, time);
+        case Mandelbox:
+            return mandelbox(position, time);
+        case Apollonian:
+        default:
+            return apollonian(position);
+    }
+}
+
+float
+bounds(Fractal fractal)
+{
+    switch (fractal) {
+        case Mandelbulb:
+            return 1.5f;
+        case MengerSponge:
+            return 1.05f;
+        case Julia:
+            return 2.0f;
+        case Mandelbox:
+            return 2.1f;
+        case Apollonian:
+        default:
+            return 1.0f;
+    }
+}
+
+const char*
+name(Fractal fractal)
+{
+    const char* names[] = {
+        "Mandelbulb", "Menger sponge", "Julia", "Apollonian", "Mandelbox"
+    };
+    return names[fractal];
+}
+
+}
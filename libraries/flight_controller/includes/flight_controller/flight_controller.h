@@ -1,6 +1,12 @@
 #pragma once
 
 #include <Eigen/Dense>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 namespace FlightController {
 
@@ -14,14 +20,73 @@ enum Direction
     Down,
 };
 
+// Camera state at the end of a simulation tick.
+struct Snapshot
+{
+    Eigen::Matrix3f rotation = Eigen::Matrix3f::Identity();
+    Eigen::Vector3f position = Eigen::Vector3f::Zero();
+    uint64_t tick = 0;
+};
+
+// One tick of a recorded camera path.
+struct PathSample
+{
+    Eigen::Vector3f position;
+    Eigen::Quaternionf orientation;
+};
+
+enum class Mode
+{
+    Flying,
+    Recording,
+    Replaying,
+    // Replaying one frame at a time through `replayFrame`.
+    Stepping,
+};
+
+// Camera simulated on its own thread at a fixed `tickRate`, so movement speed
+// does not depend on the frame rate and input is integrated even while a frame
+// is rendering. Input is handed to the thread through atomics and snapshots
+// come back through a triple buffer, neither side ever waits for the other.
+// Input still only arrives as often as the caller polls its window events.
 struct Controller
 {
-    Eigen::Matrix3f rotation{};
-    Eigen::Vector3f position{};
-    float linearSpeed{};
-    float rotationalSpeed{};
-    Eigen::Vector2f cursorPosition{};
-    Eigen::Vector2f lastCursorPosition{};
+    Eigen::Quaternionf orientation = Eigen::Quaternionf::Identity();
+    Eigen::Vector3f position = Eigen::Vector3f::Zero();
+    float linearSpeed = 1.5f;     // Units per second.
+    float rotationalSpeed = 1.0f; // Multiplies the angles given to `turn`.
+    float tickRate = 120.0f;
+    uint64_t tick = 0;
+
+    // Input, written by the caller.
+    std::atomic<uint32_t> directions{ 0 };
+    std::atomic<float> pitch{ 0.0f };
+    std::atomic<float> yaw{ 0.0f };
+    std::atomic<float> roll{ 0.0f };
+
+    // Triple buffer: the thread fills `snapshots[back]` and swaps it with
+    // `middle`, `read` swaps `middle` with `front` when it holds a newer
+    // snapshot, which is flagged by `fresh`.
+    static constexpr uint32_t fresh = 4;
+    Snapshot snapshots[3];
+    uint32_t back = 0;
+    std::atomic<uint32_t> middle{ 1 };
+    uint32_t front = 2;
+
+    // Recorded or replayed path and placements, shared with the thread under
+    // `pathMutex`. `mode` and `placed` are only written under the lock, so
+    // that the thread can skip it while flying.
+    std::mutex pathMutex;
+    std::atomic<Mode> mode{ Mode::Flying };
+    std::atomic<bool> placed{ false };
+    Eigen::Quaternionf placedOrientation;
+    Eigen::Vector3f placedPosition;
+    std::vector<PathSample> path;
+    float pathTickRate = 0.0f;
+    size_t replayTick = 0;
+
+    std::atomic<bool> running{ false };
+    std::thread thread;
 };
 
 Controller*
@@ -30,7 +95,70 @@ make();
 void
 free(Controller* self);
 
+// Starts or stops moving in `direction`.
+void
+move(Controller* self, Direction direction, bool active);
+
+// Rotates around the camera axes by the given angles (radians) on the next
+// tick.
 void
-move(Controller* self, Direction direction);
+turn(Controller* self, float pitch, float yaw, float roll);
+
+// Latest published camera state.
+Snapshot
+read(Controller* self);
+
+// Moves the camera, any replay is stopped.
+void
+place(Controller* self,
+      const Eigen::Vector3f& position,
+      const Eigen::Matrix3f& rotation);
+
+void
+startRecording(Controller* self);
+
+// Stops recording and writes the recorded path to `filePath`.
+bool
+stopRecording(Controller* self, const std::string& filePath);
+
+// Replays the path in `filePath` tick by tick, input is ignored meanwhile.
+bool
+replay(Controller* self, const std::string& filePath);
+
+// Loads the path in `filePath` for `replayFrame`, input is ignored meanwhile.
+bool
+startFrameReplay(Controller* self, const std::string& filePath);
+
+// Camera of the replayed path after `frameIndex` frames of `frameRate`,
+// whatever the time the frames take, in `snapshot`. Returns false past the
+// end of the path, where the replay ends and the camera is left.
+bool
+replayFrame(Controller* self,
+            size_t frameIndex,
+            float frameRate,
+            Snapshot& snapshot);
+
+Mode
+mode(Controller* self);
+
+// Path files hold a `PathHeader` followed by `count` samples of 7 floats:
+// position and orientation quaternion (x, y, z, w).
+struct PathHeader
+{
+    char magic[4];
+    uint32_t version;
+    float tickRate;
+    uint32_t count;
+};
+
+bool
+savePath(const std::string& filePath,
+         const std::vector<PathSample>& path,
+         float tickRate);
+
+bool
+loadPath(const std::string& filePath,
+         std::vector<PathSample>& path,
+         float& tickRate);
 
 }
@@ -1,23 +1,357 @@
 #include "flight_controller.h"
 
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
 namespace FlightController {
 
+namespace {
+
+const char pathMagic[4] = { 'F', 'C', 'P', 'T' };
+const uint32_t pathVersion = 1;
+
+void
+publish(Controller* self)
+{
+    Snapshot& snapshot = self->snapshots[self->back];
+    snapshot.rotation = self->orientation.toRotationMatrix();
+    snapshot.position = self->position;
+    snapshot.tick = self->tick;
+
+    self->back = self->middle.exchange(self->back | Controller::fresh,
+                                       std::memory_order_acq_rel) &
+                 ~Controller::fresh;
+}
+
+Eigen::Vector3f
+velocity(Controller* self)
+{
+    uint32_t directions = self->directions.load(std::memory_order_relaxed);
+    Eigen::Matrix3f rotation = self->orientation.toRotationMatrix();
+
+    Eigen::Vector3f result = Eigen::Vector3f::Zero();
+    if (directions & (1u << Forward)) {
+        result -= rotation.col(2);
+    }
+    if (directions & (1u << Backward)) {
+        result += rotation.col(2);
+    }
+    if (directions & (1u << Left)) {
+        result -= rotation.col(0);
+    }
+    if (directions & (1u << Right)) {
+        result += rotation.col(0);
+    }
+    if (directions & (1u << Down)) {
+        result -= rotation.col(1);
+    }
+    if (directions & (1u << Up)) {
+        result += rotation.col(1);
+    }
+    return result * self->linearSpeed;
+}
+
+// Advances the camera by one tick of `deltaTime` seconds and publishes it.
+void
+step(Controller* self, float deltaTime)
+{
+    float pitch = self->pitch.exchange(0.0f, std::memory_order_relaxed);
+    float yaw = self->yaw.exchange(0.0f, std::memory_order_relaxed);
+    float roll = self->roll.exchange(0.0f, std::memory_order_relaxed);
+
+    // Paths and placements are only locked when there are any.
+    std::unique_lock<std::mutex> lock(self->pathMutex, std::defer_lock);
+    Mode mode = self->mode.load(std::memory_order_acquire);
+    if (mode != Mode::Flying || self->placed.load(std::memory_order_acquire)) {
+        lock.lock();
+        mode = self->mode.load(std::memory_order_relaxed);
+        if (self->placed.load(std::memory_order_relaxed)) {
+            self->position = self->placedPosition;
+            self->orientation = self->placedOrientation;
+            self->placed.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    if (mode == Mode::Stepping) {
+        // The camera waits for the end of the path, see `replayFrame`.
+    } else if (mode == Mode::Replaying) {
+        size_t index = self->replayTick * self->pathTickRate / self->tickRate;
+        if (index < self->path.size()) {
+            self->position = self->path[index].position;
+            self->orientation = self->path[index].orientation;
+            self->replayTick++;
+        } else {
+            self->mode.store(Mode::Flying, std::memory_order_relaxed);
+        }
+    } else {
+        float factor = self->rotationalSpeed;
+        self->orientation =
+          self->orientation *
+          Eigen::AngleAxisf(yaw * factor, Eigen::Vector3f::UnitY()) *
+          Eigen::AngleAxisf(pitch * factor, Eigen::Vector3f::UnitX()) *
+          Eigen::AngleAxisf(roll * factor, Eigen::Vector3f::UnitZ());
+        self->orientation.normalize();
+
+        self->position += velocity(self) * deltaTime;
+
+        if (mode == Mode::Recording) {
+            self->path.push_back({ self->position, self->orientation });
+        }
+    }
+
+    self->tick++;
+    publish(self);
+}
+
+void
+run(Controller* self)
+{
+    using Clock = std::chrono::steady_clock;
+
+    std::chrono::duration<double> period(1.0 / self->tickRate);
+    Clock::time_point next = Clock::now();
+
+    while (self->running.load(std::memory_order_relaxed)) {
+        step(self, 1.0f / self->tickRate);
+
+        // After a stall the missed ticks are dropped rather than caught up.
+        next += std::chrono::duration_cast<Clock::duration>(period);
+        Clock::time_point now = Clock::now();
+        if (next < now - std::chrono::milliseconds(100)) {
+            next = now;
+        }
+        std::this_thread::sleep_until(next);
+    }
+}
+
+bool
+startReplay(Controller* self, const std::string& filePath, Mode mode)
+{
+    std::vector<PathSample> path;
+    float tickRate;
+    if (!loadPath(filePath, path, tickRate) || path.empty()) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(self->pathMutex);
+    self->mode = mode;
+    self->path.swap(path);
+    self->pathTickRate = tickRate;
+    self->replayTick = 0;
+    return true;
+}
+
+void
+addAtomic(std::atomic<float>& value, float addend)
+{
+    float expected = value.load(std::memory_order_relaxed);
+    while (!value.compare_exchange_weak(
+      expected, expected + addend, std::memory_order_relaxed)) {
+    }
+}
+
+}
+
 Controller*
 make()
 {
     Controller* result = new Controller;
+    publish(result);
+    result->running = true;
+    result->thread = std::thread(run, result);
     return result;
 }
 
 void
 free(Controller* self)
 {
+    self->running = false;
+    if (self->thread.joinable()) {
+        self->thread.join();
+    }
     delete self;
 }
 
 void
-move(Controller* self, Direction direction)
+move(Controller* self, Direction direction, bool active)
+{
+    if (active) {
+        self->directions.fetch_or(1u << direction, std::memory_order_relaxed);
+    } else {
+        self->directions.fetch_and(~(1u << direction),
+                                   std::memory_order_relaxed);
+    }
+}
+
+void
+turn(Controller* self, float pitch, float yaw, float roll)
+{
+    addAtomic(self->pitch, pitch);
+    addAtomic(self->yaw, yaw);
+    addAtomic(self->roll, roll);
+}
+
+Snapshot
+read(Controller* self)
+{
+    if (self->middle.load(std::memory_order_acquire) & Controller::fresh) {
+        self->front =
+          self->middle.exchange(self->front, std::memory_order_acq_rel) &
+          ~Controller::fresh;
+    }
+    return self->snapshots[self->front];
+}
+
+void
+place(Controller* self,
+      const Eigen::Vector3f& position,
+      const Eigen::Matrix3f& rotation)
+{
+    std::lock_guard<std::mutex> lock(self->pathMutex);
+    if (self->mode == Mode::Replaying || self->mode == Mode::Stepping) {
+        self->mode = Mode::Flying;
+    }
+    self->placedPosition = position;
+    self->placedOrientation = Eigen::Quaternionf(rotation).normalized();
+    self->placed.store(true, std::memory_order_release);
+}
+
+void
+startRecording(Controller* self)
+{
+    std::lock_guard<std::mutex> lock(self->pathMutex);
+    self->mode = Mode::Recording;
+    self->path.clear();
+    self->pathTickRate = self->tickRate;
+}
+
+bool
+stopRecording(Controller* self, const std::string& filePath)
+{
+    std::vector<PathSample> path;
+    float tickRate;
+    {
+        std::lock_guard<std::mutex> lock(self->pathMutex);
+        if (self->mode != Mode::Recording) {
+            return false;
+        }
+        self->mode = Mode::Flying;
+        path.swap(self->path);
+        tickRate = self->pathTickRate;
+    }
+    return savePath(filePath, path, tickRate);
+}
+
+bool
+replay(Controller* self, const std::string& filePath)
+{
+    return startReplay(self, filePath, Mode::Replaying);
+}
+
+bool
+startFrameReplay(Controller* self, const std::string& filePath)
 {
+    return startReplay(self, filePath, Mode::Stepping);
+}
+
+bool
+replayFrame(Controller* self,
+            size_t frameIndex,
+            float frameRate,
+            Snapshot& snapshot)
+{
+    std::lock_guard<std::mutex> lock(self->pathMutex);
+    if (self->mode != Mode::Stepping) {
+        return false;
+    }
+
+    // The thread may be flying the camera until its next tick, which then
+    // takes over the camera from the end of the path.
+    size_t index = frameIndex * (double)self->pathTickRate / frameRate;
+    if (index >= self->path.size()) {
+        self->mode = Mode::Flying;
+        self->placedPosition = self->path.back().position;
+        self->placedOrientation = self->path.back().orientation;
+        self->placed.store(true, std::memory_order_release);
+        return false;
+    }
+
+    snapshot.rotation = self->path[index].orientation.toRotationMatrix();
+    snapshot.position = self->path[index].position;
+    snapshot.tick = index;
+    return true;
+}
+
+Mode
+mode(Controller* self)
+{
+    return self->mode.load(std::memory_order_acquire);
+}
+
+bool
+savePath(const std::string& filePath,
+         const std::vector<PathSample>& path,
+         float tickRate)
+{
+    FILE* file = fopen(filePath.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+
+    PathHeader header;
+    memcpy(header.magic, pathMagic, sizeof(pathMagic));
+    header.version = pathVersion;
+    header.tickRate = tickRate;
+    header.count = path.size();
+    fwrite(&header, sizeof(header), 1, file);
+
+    for (const PathSample& sample : path) {
+        float values[7] = { sample.position.x(),    sample.position.y(),
+                            sample.position.z(),    sample.orientation.x(),
+                            sample.orientation.y(), sample.orientation.z(),
+                            sample.orientation.w() };
+        fwrite(values, sizeof(values), 1, file);
+    }
+
+    bool written = ferror(file) == 0;
+    return fclose(file) == 0 && written;
+}
+
+bool
+loadPath(const std::string& filePath,
+         std::vector<PathSample>& path,
+         float& tickRate)
+{
+    FILE* file = fopen(filePath.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+
+    PathHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, pathMagic, sizeof(pathMagic)) != 0 ||
+        header.version != pathVersion || !(header.tickRate > 0.0f)) {
+        fclose(file);
+        return false;
+    }
+
+    path.clear();
+    path.reserve(header.count);
+    float values[7];
+    for (uint32_t i = 0; i < header.count; i++) {
+        if (fread(values, sizeof(values), 1, file) != 1) {
+            fclose(file);
+            return false;
+        }
+        path.push_back(
+          { Eigen::Vector3f(values[0], values[1], values[2]),
+            Eigen::Quaternionf(values[6], values[3], values[4], values[5]) });
+    }
+    tickRate = header.tickRate;
+
+    fclose(file);
+    return true;
 }
 
 }